@@ -0,0 +1,511 @@
+/*
+Headless end-to-end benchmark for the Hero Watcher filter.
+
+Replays a directory of PNG frames through the real filter code at a fixed FPS,
+with obs_standin.cpp standing in for the GPU. Each frame is held on screen for
+--hold seconds; a frame named "<anything>-<hero>.png" also declares the hero
+that should be detected while it is shown.
+
+Reports hero swap to verdict latency, graphics lock wait/hold times for the
+render loop and the detection thread, scan overruns and render deadline misses.
+Verdicts come from the filter's hero_detected signal. Timelines and any debug
+images are written to a fresh temporary directory, printed at the end.
+
+With --compare, each frame is instead matched once per backend and the census
+backends are scored against correlation (NCC), e.g. on the committed sample
+crops: --compare --frames <plugin source dir>. utils/make_synthetic_heroes.py
+generates templates and labelled frames for both modes.
+*/
+
+#include "obs_standin.h"
+#include "herowatcher_plugin.h"
+
+#include <obs-module.h>
+#include <util/base.h>
+#include <util/platform.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" struct obs_source_info hero_watcher;
+
+#ifndef HEROWATCHER_DATA_DIR
+#define HEROWATCHER_DATA_DIR "data"
+#endif
+
+// Timed runs per frame and backend in --compare
+#define HERO_BENCH_COMPARE_RUNS 5
+
+struct bench_frame {
+	std::string name;
+	std::string expected_hero;
+	cv::Mat rgba;
+};
+
+struct bench_verdict {
+	uint64_t verdict_ns;
+	uint64_t capture_ns;
+	std::string hero;
+	double score;
+};
+
+struct bench_options {
+	std::string frames_dir;
+	std::string data_dir = HEROWATCHER_DATA_DIR;
+	double fps = 60.0;
+	double hold = 10.0;
+	double render_ms = 0.0;
+	int refresh = 1;
+	int budget_ms = 0;
+	hero_match_backend backend = HERO_MATCH_NCC;
+	bool compare = false;
+	bool low_priority = false;
+	int lag_every = 0;
+	int skip_every = 0;
+	int crop[4] = {0, 0, 0, 0};
+	bool verbose = false;
+};
+
+static std::mutex verdict_mutex;
+static std::vector<bench_verdict> verdicts;
+static bool verbose_log;
+
+static void bench_log_handler(int level, const char *format, va_list args, void *param)
+{
+	UNUSED_PARAMETER(param);
+	if (!verbose_log && level > LOG_WARNING)
+		return;
+
+	char msg[4096];
+	vsnprintf(msg, sizeof(msg), format, args);
+	fprintf(stderr, "%s\n", msg);
+}
+
+// Runs on the detection thread once a scan has a verdict
+static void bench_hero_detected(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(data);
+	bench_verdict verdict;
+	verdict.verdict_ns = os_gettime_ns();
+	verdict.capture_ns = (uint64_t)calldata_int(cd, "timestamp");
+	verdict.hero = calldata_string(cd, "hero");
+	verdict.score = calldata_float(cd, "score");
+
+	std::lock_guard<std::mutex> lock(verdict_mutex);
+	verdicts.push_back(verdict);
+}
+
+// Frame that was on screen when the scan captured, swap_ns is when each frame went up
+static int frame_at(const std::vector<uint64_t> &swap_ns, uint64_t capture_ns)
+{
+	int index = -1;
+	for (size_t i = 0; i < swap_ns.size() && swap_ns[i] && swap_ns[i] <= capture_ns; i++)
+		index = (int)i;
+	return index;
+}
+
+static void busy_wait_ns(uint64_t duration_ns)
+{
+	uint64_t end = os_gettime_ns() + duration_ns;
+	while (os_gettime_ns() < end)
+		;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s --frames DIR [options]\n"
+		"  --data DIR         plugin data dir containing hero_images (default %s)\n"
+		"  --fps N            render loop rate (default 60)\n"
+		"  --hold SECONDS     time each frame stays on screen (default 10)\n"
+		"  --render-ms N      extra graphics lock hold per render pass, e.g. other sources (default 0)\n"
+		"  --refresh SECONDS  detection timer (default 1)\n"
+		"  --budget-ms N      governor CPU budget, 0 = unlimited (default 0)\n"
+		"  --low-priority     run detection at low priority\n"
+		"  --backend NAME     ncc, census or census-ncc (default ncc)\n"
+		"  --compare          match each frame with every backend and compare to ncc\n"
+		"  --lag-every N      report a lagged render frame every N render frames\n"
+		"  --skip-every N     report a skipped encoder frame every N render frames\n"
+		"  --crop L,T,R,B     filter crop in pixels\n"
+		"  --verbose          print all filter log output\n",
+		argv0, HEROWATCHER_DATA_DIR);
+}
+
+static bool parse_args(int argc, char **argv, bench_options &opts)
+{
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--frames" && has_value)
+			opts.frames_dir = argv[++i];
+		else if (arg == "--data" && has_value)
+			opts.data_dir = argv[++i];
+		else if (arg == "--fps" && has_value)
+			opts.fps = atof(argv[++i]);
+		else if (arg == "--hold" && has_value)
+			opts.hold = atof(argv[++i]);
+		else if (arg == "--render-ms" && has_value)
+			opts.render_ms = atof(argv[++i]);
+		else if (arg == "--refresh" && has_value)
+			opts.refresh = atoi(argv[++i]);
+		else if (arg == "--budget-ms" && has_value)
+			opts.budget_ms = atoi(argv[++i]);
+		else if (arg == "--low-priority")
+			opts.low_priority = true;
+		else if (arg == "--backend" && has_value) {
+			std::string name = argv[++i];
+			if (name == "ncc")
+				opts.backend = HERO_MATCH_NCC;
+			else if (name == "census")
+				opts.backend = HERO_MATCH_CENSUS;
+			else if (name == "census-ncc")
+				opts.backend = HERO_MATCH_CENSUS_NCC;
+			else
+				return false;
+		} else if (arg == "--compare")
+			opts.compare = true;
+		else if (arg == "--lag-every" && has_value)
+			opts.lag_every = atoi(argv[++i]);
+		else if (arg == "--skip-every" && has_value)
+			opts.skip_every = atoi(argv[++i]);
+		else if (arg == "--crop" && has_value) {
+			if (sscanf(argv[++i], "%d,%d,%d,%d", &opts.crop[0], &opts.crop[1], &opts.crop[2],
+				   &opts.crop[3]) != 4)
+				return false;
+		} else if (arg == "--verbose")
+			opts.verbose = true;
+		else
+			return false;
+	}
+	return !opts.frames_dir.empty() && opts.fps > 0.0 && opts.hold > 0.0 && opts.render_ms >= 0.0 &&
+	       opts.refresh > 0;
+}
+
+static bool load_frames(const std::string &dir, bool same_size, std::vector<bench_frame> &frames)
+{
+	std::vector<std::filesystem::path> paths;
+	std::error_code ec;
+	for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+		if (entry.is_regular_file() && entry.path().extension() == ".png")
+			paths.push_back(entry.path());
+	}
+	if (ec) {
+		fprintf(stderr, "Could not read frames directory %s: %s\n", dir.c_str(), ec.message().c_str());
+		return false;
+	}
+	std::sort(paths.begin(), paths.end());
+
+	for (const auto &path : paths) {
+		cv::Mat image = cv::imread(path.string(), cv::IMREAD_COLOR);
+		if (image.empty()) {
+			fprintf(stderr, "Skipping unreadable frame %s\n", path.string().c_str());
+			continue;
+		}
+
+		bench_frame frame;
+		frame.name = path.filename().string();
+		std::string stem = path.stem().string();
+		size_t dash = stem.find('-');
+		if (dash != std::string::npos)
+			frame.expected_hero = stem.substr(dash + 1);
+		cv::cvtColor(image, frame.rgba, cv::COLOR_BGR2RGBA);
+
+		if (same_size && !frames.empty() && frame.rgba.size() != frames.front().rgba.size()) {
+			fprintf(stderr, "Frame %s does not match the size of the first frame\n", frame.name.c_str());
+			return false;
+		}
+		frames.push_back(std::move(frame));
+	}
+
+	if (frames.empty()) {
+		fprintf(stderr, "No PNG frames found in %s\n", dir.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Runs every backend directly on each frame, NCC being the reference verdict.
+// Times the matching call only, the templates are loaded before the first timed run.
+static int run_compare(const std::vector<bench_frame> &frames)
+{
+	static const hero_match_backend backends[] = {HERO_MATCH_NCC, HERO_MATCH_CENSUS, HERO_MATCH_CENSUS_NCC};
+	static const char *names[] = {"ncc", "census", "census-ncc"};
+	constexpr size_t count = sizeof(backends) / sizeof(backends[0]);
+
+	uint64_t time_total[count] = {0};
+	size_t agree[count] = {0};
+	size_t correct[count] = {0};
+	size_t labelled = 0, reference = 0;
+
+	// Untimed warm-up loads the shared template cache
+	{
+		hero_governor governor = {};
+		hero_match match = {};
+		const cv::Mat &rgba = frames.front().rgba;
+		do_template_match(rgba.data, rgba.cols, rgba.rows, rgba.cols * 4, HERO_MATCH_NCC, &governor, &match);
+	}
+
+	for (const auto &frame : frames) {
+		printf("%s (%dx%d)\n", frame.name.c_str(), frame.rgba.cols, frame.rgba.rows);
+		if (!frame.expected_hero.empty())
+			labelled++;
+
+		std::string ncc_hero;
+		for (size_t b = 0; b < count; b++) {
+			hero_governor governor = {};
+			hero_match match = {};
+			uint64_t elapsed = UINT64_MAX;
+			bool ok = false;
+			// Best of a few runs, so a single preempted call doesn't skew the average
+			for (int run = 0; run < HERO_BENCH_COMPARE_RUNS; run++) {
+				uint64_t start = os_gettime_ns();
+				ok = do_template_match(frame.rgba.data, frame.rgba.cols, frame.rgba.rows,
+						       frame.rgba.cols * 4, backends[b], &governor, &match);
+				elapsed = std::min(elapsed, os_gettime_ns() - start);
+			}
+			time_total[b] += elapsed;
+
+			if (!ok) {
+				printf("  %-12s no verdict  %9.3f ms\n", names[b], elapsed / 1e6);
+				continue;
+			}
+			if (b == 0) {
+				ncc_hero = match.hero;
+				reference++;
+			}
+			if (!ncc_hero.empty() && ncc_hero == match.hero)
+				agree[b]++;
+			if (!frame.expected_hero.empty() && frame.expected_hero == match.hero)
+				correct[b]++;
+			printf("  %-12s %-16s score %.3f  %9.3f ms\n", names[b], match.hero, match.score, elapsed / 1e6);
+		}
+	}
+
+	printf("\nSummary (%zu frames):\n", frames.size());
+	for (size_t b = 0; b < count; b++) {
+		printf("  %-12s avg %9.3f ms  agrees with ncc %zu / %zu", names[b],
+		       time_total[b] / (double)frames.size() / 1e6, agree[b], reference);
+		if (labelled)
+			printf("  correct %zu / %zu", correct[b], labelled);
+		printf("\n");
+	}
+	return 0;
+}
+
+static void print_lock_stats(const char *name, const standin_lock_stats &stats)
+{
+	double count = stats.count ? (double)stats.count : 1.0;
+	printf("  %-10s %8llu  wait avg %8.3f ms  max %8.3f ms  hold avg %8.3f ms  max %8.3f ms\n", name,
+	       (unsigned long long)stats.count, stats.wait_total_ns / count / 1e6, stats.wait_max_ns / 1e6,
+	       stats.hold_total_ns / count / 1e6, stats.hold_max_ns / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	bench_options opts;
+	if (!parse_args(argc, argv, opts)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<bench_frame> frames;
+	if (!load_frames(opts.frames_dir, !opts.compare, frames))
+		return 1;
+
+	// Keep everything the filter writes out of the caller's directories
+	std::error_code ec;
+	std::filesystem::path data_dir = std::filesystem::absolute(opts.data_dir);
+	std::filesystem::path work_dir = std::filesystem::temp_directory_path(ec) /
+					 ("herowatcher-bench-" + std::to_string(os_gettime_ns()));
+	std::filesystem::create_directories(work_dir, ec);
+	if (!ec)
+		std::filesystem::current_path(work_dir, ec);
+	if (ec) {
+		fprintf(stderr, "Could not set up working directory %s: %s\n", work_dir.string().c_str(),
+			ec.message().c_str());
+		return 1;
+	}
+
+	verbose_log = opts.verbose;
+	base_set_log_handler(bench_log_handler, nullptr);
+	standin_set_data_path(data_dir.string().c_str());
+	standin_set_config_path(work_dir.string().c_str());
+	standin_mark_render_thread();
+	hero_matching_init();
+
+	if (opts.compare)
+		return run_compare(frames);
+
+	uint32_t width = (uint32_t)frames.front().rgba.cols;
+	uint32_t height = (uint32_t)frames.front().rgba.rows;
+	obs_source_t *target = standin_source_create("Bench Frames", nullptr, width, height);
+	obs_source_t *context = standin_source_create("Hero Watcher", target, width, height);
+
+	obs_data_t *settings = obs_data_create();
+	hero_watcher.get_defaults(settings);
+	obs_data_set_bool(settings, "tagging_enabled", true);
+	obs_data_set_int(settings, "refresh_seconds", opts.refresh);
+	obs_data_set_int(settings, "left", opts.crop[0]);
+	obs_data_set_int(settings, "top", opts.crop[1]);
+	obs_data_set_int(settings, "right", opts.crop[2]);
+	obs_data_set_int(settings, "bottom", opts.crop[3]);
+	obs_data_set_int(settings, "cpu_budget_ms", opts.budget_ms);
+	obs_data_set_bool(settings, "low_priority", opts.low_priority);
+	obs_data_set_int(settings, "match_backend", opts.backend);
+
+	void *filter = hero_watcher.create(settings, context);
+	if (!filter) {
+		fprintf(stderr, "Filter creation failed\n");
+		return 1;
+	}
+	hero_watcher.update(filter, settings);
+	hero_watcher.filter_add(filter, target);
+	hero_watcher.activate(filter);
+	signal_handler_connect(obs_source_get_signal_handler(context), "hero_detected", bench_hero_detected, nullptr);
+
+	hero_watcher_data *state = (hero_watcher_data *)filter;
+	obs_enter_graphics();
+	gs_texrender_t *canvas = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	obs_leave_graphics();
+	const uint64_t render_hold_ns = (uint64_t)(opts.render_ms * 1e6);
+	standin_reset_lock_stats();
+
+	printf("Replaying %zu frames (%ux%u) at %.1f FPS, %.1f s each\n", frames.size(), width, height, opts.fps,
+	       opts.hold);
+
+	const uint64_t interval_ns = (uint64_t)(1e9 / opts.fps);
+	const uint64_t ticks_per_frame = std::max<uint64_t>(1, (uint64_t)(opts.hold * opts.fps));
+	std::vector<uint64_t> swap_ns(frames.size(), 0);
+	uint64_t deadline_misses = 0;
+	uint64_t scan_overruns = 0;
+	uint64_t scans_started = 0;
+	uint64_t tick_count = 0;
+	uint64_t next_ns = os_gettime_ns();
+
+	for (size_t i = 0; i < frames.size(); i++) {
+		for (uint64_t t = 0; t < ticks_per_frame; t++) {
+			if (opts.lag_every > 0 && tick_count % (uint64_t)opts.lag_every == 0)
+				standin_add_lagged_frames(1);
+			if (opts.skip_every > 0 && tick_count % (uint64_t)opts.skip_every == 0)
+				standin_add_skipped_frames(1);
+
+			// The timer firing while the previous scan still runs is an overrun,
+			// otherwise it started a scan. A held timer does not reset.
+			bool scan_running = os_atomic_load_bool(&state->hero_detection_running);
+			float remaining = state->remaining_time;
+			hero_watcher.video_tick(filter, (float)(interval_ns / 1e9));
+			if (state->remaining_time > remaining) {
+				if (scan_running)
+					scan_overruns++;
+				else
+					scans_started++;
+			}
+
+			// Render pass under the graphics lock: swap in the frame, then draw the
+			// filter chain into the canvas like OBS's main texture
+			obs_enter_graphics();
+			if (t == 0) {
+				standin_set_frame(target, frames[i].rgba.data);
+				swap_ns[i] = os_gettime_ns();
+			}
+			gs_texrender_begin(canvas, width, height);
+			hero_watcher.video_render(filter, nullptr);
+			gs_texrender_end(canvas);
+			busy_wait_ns(render_hold_ns);
+			obs_leave_graphics();
+
+			tick_count++;
+			next_ns += interval_ns;
+			if (os_gettime_ns() > next_ns) {
+				deadline_misses++;
+				next_ns = os_gettime_ns();
+			} else {
+				os_sleepto_ns(next_ns);
+			}
+		}
+	}
+
+	// Snapshot before teardown, destroy takes the lock for its own cleanup
+	standin_lock_stats render_stats, detect_stats;
+	standin_get_lock_stats(true, &render_stats);
+	standin_get_lock_stats(false, &detect_stats);
+
+	hero_watcher.deactivate(filter);
+	hero_watcher.destroy(filter);
+	signal_handler_disconnect(obs_source_get_signal_handler(context), "hero_detected", bench_hero_detected,
+				  nullptr);
+	obs_data_release(settings);
+	obs_enter_graphics();
+	gs_texrender_destroy(canvas);
+	obs_leave_graphics();
+	standin_source_destroy(context);
+	standin_source_destroy(target);
+
+	// First verdict captured while each frame was on screen
+	printf("\nLatency (hero swap on screen -> verdict):\n");
+	uint64_t latency_total = 0, latency_max = 0, scan_total = 0, scan_max = 0;
+	size_t detected = 0, correct = 0, labelled = 0;
+	for (size_t i = 0; i < frames.size(); i++) {
+		const bench_verdict *first = nullptr;
+		for (const auto &v : verdicts) {
+			if (frame_at(swap_ns, v.capture_ns) == (int)i) {
+				first = &v;
+				break;
+			}
+		}
+
+		if (!frames[i].expected_hero.empty())
+			labelled++;
+		if (!first) {
+			printf("  %-32s no verdict\n", frames[i].name.c_str());
+			continue;
+		}
+
+		uint64_t latency = first->verdict_ns - swap_ns[i];
+		uint64_t scan = first->verdict_ns - first->capture_ns;
+		latency_total += latency;
+		latency_max = std::max(latency_max, latency);
+		scan_total += scan;
+		scan_max = std::max(scan_max, scan);
+		detected++;
+
+		bool ok = frames[i].expected_hero.empty() || frames[i].expected_hero == first->hero;
+		if (ok && !frames[i].expected_hero.empty())
+			correct++;
+		printf("  %-32s %-16s score %.3f  latency %9.3f ms  scan %9.3f ms%s\n", frames[i].name.c_str(),
+		       first->hero.c_str(), first->score, latency / 1e6, scan / 1e6, ok ? "" : "  WRONG");
+	}
+
+	printf("\nSummary:\n");
+	if (detected) {
+		printf("  latency avg %.3f ms  max %.3f ms\n", latency_total / (double)detected / 1e6,
+		       latency_max / 1e6);
+		printf("  scan    avg %.3f ms  max %.3f ms\n", scan_total / (double)detected / 1e6, scan_max / 1e6);
+	}
+	printf("  frames with a verdict: %zu / %zu\n", detected, frames.size());
+	if (labelled)
+		printf("  correct heroes: %zu / %zu\n", correct, labelled);
+	printf("  scans started: %llu  verdicts: %zu  scan overruns: %llu  render deadline misses: %llu / %llu\n",
+	       (unsigned long long)scans_started, verdicts.size(), (unsigned long long)scan_overruns,
+	       (unsigned long long)deadline_misses, (unsigned long long)tick_count);
+
+	printf("\nGraphics lock:\n");
+	print_lock_stats("render", render_stats);
+	print_lock_stats("detection", detect_stats);
+	printf("\nOutput written to %s\n", work_dir.string().c_str());
+
+	return 0;
+}
@@ -0,0 +1,490 @@
+#include "obs_standin.h"
+
+#include <obs-module.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <graphics/vec2.h>
+#include <media-io/video-io.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct gs_texture {
+	std::vector<uint8_t> pixels;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+struct gs_texture_render {
+	gs_texture tex;
+	bool rendered = false;
+};
+
+struct gs_stage_surface {
+	std::vector<uint8_t> pixels;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+struct gs_effect {
+	int unused;
+};
+
+struct gs_effect_param {
+	int unused;
+};
+
+struct video_output {
+	int unused;
+};
+
+struct obs_source {
+	std::string name;
+	obs_source_t *target = nullptr;
+	signal_handler_t *signals = nullptr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	const uint8_t *frame = nullptr;
+};
+
+static std::string data_path;
+static std::string config_path;
+static std::thread::id render_thread;
+
+static std::mutex graphics_mutex;
+static std::mutex stats_mutex;
+static standin_lock_stats render_stats;
+static standin_lock_stats detect_stats;
+static thread_local uint64_t lock_acquired_ns;
+static thread_local uint64_t lock_wait_ns;
+
+static std::atomic<uint32_t> lagged_frames{0};
+static std::atomic<uint32_t> skipped_frames{0};
+
+// Render state of the thread currently inside the graphics lock
+static thread_local gs_texture_render *current_target;
+static thread_local std::vector<vec2> matrix_stack;
+static thread_local vec2 translation;
+
+static video_output standin_video;
+static gs_effect standin_effect;
+static gs_effect_param standin_param;
+
+void standin_set_data_path(const char *path)
+{
+	data_path = path;
+}
+
+void standin_set_config_path(const char *path)
+{
+	config_path = path;
+}
+
+void standin_mark_render_thread(void)
+{
+	render_thread = std::this_thread::get_id();
+}
+
+obs_source_t *standin_source_create(const char *name, obs_source_t *target, uint32_t width, uint32_t height)
+{
+	obs_source_t *source = new obs_source;
+	source->name = name;
+	source->target = target;
+	source->width = width;
+	source->height = height;
+	source->signals = signal_handler_create();
+	signal_handler_add(source->signals, "void enable(ptr source, bool enabled)");
+	return source;
+}
+
+void standin_source_destroy(obs_source_t *source)
+{
+	signal_handler_destroy(source->signals);
+	delete source;
+}
+
+void standin_set_frame(obs_source_t *source, const uint8_t *rgba)
+{
+	source->frame = rgba;
+}
+
+void standin_add_lagged_frames(uint32_t frames)
+{
+	lagged_frames += frames;
+}
+
+void standin_add_skipped_frames(uint32_t frames)
+{
+	skipped_frames += frames;
+}
+
+void standin_reset_lock_stats(void)
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	render_stats = {};
+	detect_stats = {};
+}
+
+void standin_get_lock_stats(bool render, standin_lock_stats *stats)
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	*stats = render ? render_stats : detect_stats;
+}
+
+/* ------------------------------------------------------------------------- */
+/* libobs core                                                                */
+
+void obs_enter_graphics(void)
+{
+	uint64_t start = os_gettime_ns();
+	graphics_mutex.lock();
+	lock_acquired_ns = os_gettime_ns();
+	lock_wait_ns = lock_acquired_ns - start;
+}
+
+void obs_leave_graphics(void)
+{
+	uint64_t hold = os_gettime_ns() - lock_acquired_ns;
+	graphics_mutex.unlock();
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	standin_lock_stats &stats = std::this_thread::get_id() == render_thread ? render_stats : detect_stats;
+	stats.count++;
+	stats.wait_total_ns += lock_wait_ns;
+	stats.wait_max_ns = std::max(stats.wait_max_ns, lock_wait_ns);
+	stats.hold_total_ns += hold;
+	stats.hold_max_ns = std::max(stats.hold_max_ns, hold);
+}
+
+uint32_t obs_get_lagged_frames(void)
+{
+	return lagged_frames.load();
+}
+
+video_t *obs_get_video(void)
+{
+	return &standin_video;
+}
+
+uint32_t video_output_get_skipped_frames(const video_t *video)
+{
+	UNUSED_PARAMETER(video);
+	return skipped_frames.load();
+}
+
+float obs_get_video_sdr_white_level(void)
+{
+	return 300.0f;
+}
+
+obs_module_t *obs_current_module(void)
+{
+	return nullptr;
+}
+
+const char *obs_module_text(const char *lookup_string)
+{
+	return lookup_string;
+}
+
+char *obs_find_module_file(obs_module_t *module, const char *file)
+{
+	UNUSED_PARAMETER(module);
+	struct dstr path;
+	dstr_init_copy(&path, data_path.c_str());
+	dstr_cat(&path, "/");
+	dstr_cat(&path, file);
+	return path.array;
+}
+
+char *obs_module_get_config_path(obs_module_t *module, const char *file)
+{
+	UNUSED_PARAMETER(module);
+	struct dstr path;
+	dstr_init_copy(&path, config_path.c_str());
+	dstr_cat(&path, "/");
+	dstr_cat(&path, file);
+	return path.array;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Sources                                                                    */
+
+obs_source_t *obs_filter_get_target(const obs_source_t *filter)
+{
+	return filter->target;
+}
+
+obs_source_t *obs_filter_get_parent(const obs_source_t *filter)
+{
+	return filter->target;
+}
+
+const char *obs_source_get_name(const obs_source_t *source)
+{
+	return source->name.c_str();
+}
+
+uint32_t obs_source_get_width(obs_source_t *source)
+{
+	return source->width;
+}
+
+uint32_t obs_source_get_height(obs_source_t *source)
+{
+	return source->height;
+}
+
+uint32_t obs_source_get_base_width(obs_source_t *source)
+{
+	return source->width;
+}
+
+uint32_t obs_source_get_base_height(obs_source_t *source)
+{
+	return source->height;
+}
+
+enum gs_color_space obs_source_get_color_space(obs_source_t *source, size_t count,
+					       const enum gs_color_space *preferred_spaces)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(count);
+	UNUSED_PARAMETER(preferred_spaces);
+	return GS_CS_SRGB;
+}
+
+void obs_source_update(obs_source_t *source, obs_data_t *settings)
+{
+	// The bench calls update itself once create has returned the filter data
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(settings);
+}
+
+signal_handler_t *obs_source_get_signal_handler(const obs_source_t *source)
+{
+	return source->signals;
+}
+
+// Blits the current frame into the active texrender at the pushed translation
+void obs_source_video_render(obs_source_t *source)
+{
+	if (!current_target || !source->frame)
+		return;
+
+	gs_texture &dst = current_target->tex;
+	int offset_x = (int)translation.x;
+	int offset_y = (int)translation.y;
+
+	for (uint32_t y = 0; y < dst.height; y++) {
+		int src_y = (int)y - offset_y;
+		if (src_y < 0 || src_y >= (int)source->height)
+			continue;
+
+		int first = std::max(0, offset_x);
+		int last = std::min((int)dst.width, (int)source->width + offset_x);
+		if (first >= last)
+			continue;
+
+		const uint8_t *src_row = source->frame + ((size_t)src_y * source->width + (first - offset_x)) * 4;
+		memcpy(dst.pixels.data() + ((size_t)y * dst.width + first) * 4, src_row, (size_t)(last - first) * 4);
+	}
+
+	current_target->rendered = true;
+}
+
+// Filters in the chain either pass the parent through or draw it with their effect,
+// both come down to rendering the parent into the current target here
+void obs_source_skip_video_filter(obs_source_t *filter)
+{
+	obs_source_video_render(filter->target);
+}
+
+bool obs_source_process_filter_begin_with_color_space(obs_source_t *filter, enum gs_color_format format,
+						       enum gs_color_space space,
+						       enum obs_allow_direct_render allow_direct)
+{
+	UNUSED_PARAMETER(format);
+	UNUSED_PARAMETER(space);
+	UNUSED_PARAMETER(allow_direct);
+	return filter->target != nullptr;
+}
+
+void obs_source_process_filter_tech_end(obs_source_t *filter, gs_effect_t *effect, uint32_t width, uint32_t height,
+					const char *tech_name)
+{
+	UNUSED_PARAMETER(effect);
+	UNUSED_PARAMETER(width);
+	UNUSED_PARAMETER(height);
+	UNUSED_PARAMETER(tech_name);
+	obs_source_video_render(filter->target);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Graphics                                                                   */
+
+gs_effect_t *gs_effect_create_from_file(const char *file, char **error_string)
+{
+	UNUSED_PARAMETER(file);
+	UNUSED_PARAMETER(error_string);
+	return &standin_effect;
+}
+
+void gs_effect_destroy(gs_effect_t *effect)
+{
+	UNUSED_PARAMETER(effect);
+}
+
+gs_eparam_t *gs_effect_get_param_by_name(const gs_effect_t *effect, const char *name)
+{
+	UNUSED_PARAMETER(effect);
+	UNUSED_PARAMETER(name);
+	return &standin_param;
+}
+
+void gs_effect_set_float(gs_eparam_t *param, float val)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_vec2(gs_eparam_t *param, const struct vec2 *val)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(val);
+}
+
+enum gs_color_space gs_get_color_space(void)
+{
+	return GS_CS_SRGB;
+}
+
+enum gs_color_format gs_get_format_from_space(enum gs_color_space space)
+{
+	UNUSED_PARAMETER(space);
+	return GS_RGBA;
+}
+
+gs_texrender_t *gs_texrender_create(enum gs_color_format format, enum gs_zstencil_format zsformat)
+{
+	UNUSED_PARAMETER(format);
+	UNUSED_PARAMETER(zsformat);
+	return new gs_texture_render;
+}
+
+void gs_texrender_destroy(gs_texrender_t *texrender)
+{
+	delete texrender;
+}
+
+bool gs_texrender_begin(gs_texrender_t *texrender, uint32_t cx, uint32_t cy)
+{
+	texrender->tex.width = cx;
+	texrender->tex.height = cy;
+	texrender->tex.pixels.assign((size_t)cx * cy * 4, 0);
+	texrender->rendered = false;
+	current_target = texrender;
+	matrix_stack.clear();
+	vec2_zero(&translation);
+	return true;
+}
+
+void gs_texrender_end(gs_texrender_t *texrender)
+{
+	UNUSED_PARAMETER(texrender);
+	current_target = nullptr;
+}
+
+gs_texture_t *gs_texrender_get_texture(const gs_texrender_t *texrender)
+{
+	return texrender->rendered ? const_cast<gs_texture_t *>(&texrender->tex) : nullptr;
+}
+
+gs_stagesurf_t *gs_stagesurface_create(uint32_t width, uint32_t height, enum gs_color_format color_format)
+{
+	UNUSED_PARAMETER(color_format);
+	gs_stagesurf_t *stage = new gs_stage_surface;
+	stage->width = width;
+	stage->height = height;
+	stage->pixels.resize((size_t)width * height * 4);
+	return stage;
+}
+
+void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
+{
+	delete stagesurf;
+}
+
+void gs_stage_texture(gs_stagesurf_t *dst, gs_texture_t *src)
+{
+	if (dst->width == src->width && dst->height == src->height)
+		dst->pixels = src->pixels;
+}
+
+bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data, uint32_t *linesize)
+{
+	*data = stagesurf->pixels.data();
+	*linesize = stagesurf->width * 4;
+	return true;
+}
+
+void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
+{
+	UNUSED_PARAMETER(stagesurf);
+}
+
+void gs_flush(void) {}
+
+void gs_blend_state_push(void) {}
+
+void gs_blend_state_pop(void) {}
+
+void gs_blend_function(enum gs_blend_type src, enum gs_blend_type dest)
+{
+	UNUSED_PARAMETER(src);
+	UNUSED_PARAMETER(dest);
+}
+
+void gs_ortho(float left, float right, float top, float bottom, float znear, float zfar)
+{
+	UNUSED_PARAMETER(left);
+	UNUSED_PARAMETER(right);
+	UNUSED_PARAMETER(top);
+	UNUSED_PARAMETER(bottom);
+	UNUSED_PARAMETER(znear);
+	UNUSED_PARAMETER(zfar);
+}
+
+void gs_set_viewport(int x, int y, int width, int height)
+{
+	UNUSED_PARAMETER(x);
+	UNUSED_PARAMETER(y);
+	UNUSED_PARAMETER(width);
+	UNUSED_PARAMETER(height);
+}
+
+void gs_matrix_push(void)
+{
+	matrix_stack.push_back(translation);
+}
+
+void gs_matrix_pop(void)
+{
+	if (matrix_stack.empty())
+		return;
+	translation = matrix_stack.back();
+	matrix_stack.pop_back();
+}
+
+void gs_matrix_translate3f(float x, float y, float z)
+{
+	UNUSED_PARAMETER(z);
+	translation.x += x;
+	translation.y += y;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <obs.h>
+
+// CPU stand-in for the gs_* and obs_source_* calls the filter makes. The filter
+// code is linked unchanged, frames come from the bench instead of a GPU.
+
+struct standin_lock_stats {
+	uint64_t count;
+	uint64_t wait_total_ns;
+	uint64_t wait_max_ns;
+	uint64_t hold_total_ns;
+	uint64_t hold_max_ns;
+};
+
+void standin_set_data_path(const char *path);
+// obs_module_config_path resolves below this directory
+void standin_set_config_path(const char *path);
+void standin_mark_render_thread(void);
+
+// target is the filter's parent, NULL for a plain source
+obs_source_t *standin_source_create(const char *name, obs_source_t *target, uint32_t width, uint32_t height);
+void standin_source_destroy(obs_source_t *source);
+
+// Caller holds the graphics lock, like a render thread swapping in a new frame
+void standin_set_frame(obs_source_t *source, const uint8_t *rgba);
+
+// Render lag as reported by obs_get_lagged_frames
+void standin_add_lagged_frames(uint32_t frames);
+// Encoder lag as reported by video_output_get_skipped_frames
+void standin_add_skipped_frames(uint32_t frames);
+// Drops the lock time spent so far, e.g. during filter setup
+void standin_reset_lock_stats(void);
+void standin_get_lock_stats(bool render_thread, struct standin_lock_stats *stats);
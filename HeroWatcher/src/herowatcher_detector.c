@@ -41,10 +41,24 @@ static bool hero_crop_init(struct hero_crop_context *ctx, void *data)
 }
 
 
+static void hero_detected_signal(struct hero_watcher_data *filter, const struct hero_match *match, uint64_t frame_ts)
+{
+	calldata_t cd = {0};
+	calldata_set_ptr(&cd, "source", filter->context);
+	calldata_set_string(&cd, "hero", match->hero);
+	calldata_set_float(&cd, "score", match->score);
+	calldata_set_int(&cd, "timestamp", (long long)frame_ts);
+	signal_handler_signal(obs_source_get_signal_handler(filter->context), "hero_detected", &cd);
+	calldata_free(&cd);
+}
+
 void *hero_detection_thread(void *data)
 {
 	blog(LOG_DEBUG, "[%s] Starting hero detection thread!", __func__);
 	struct hero_crop_context ctx = {0};
+	uint8_t *frame = NULL;
+	uint32_t frame_linesize = 0;
+	uint64_t frame_ts = 0;
     
 	if (!hero_crop_init(&ctx, data))
 	{
@@ -52,6 +66,8 @@ void *hero_detection_thread(void *data)
 		goto done;
 	}
 
+	hero_governor_thread_init(&ctx.filter->governor);
+
 	obs_enter_graphics();
 		ctx.texrender = gs_texrender_create(ctx.filter->color_format, GS_ZS_NONE);
 		ctx.stage = gs_stagesurface_create(ctx.crop_width, ctx.crop_height, ctx.filter->color_format);
@@ -76,7 +92,12 @@ void *hero_detection_thread(void *data)
 			uint8_t *mapped_data;
 			uint32_t linesize;
 			if (gs_stagesurface_map(ctx.stage, &mapped_data, &linesize)) {
-    			do_template_match(mapped_data, ctx.crop_width, ctx.crop_height, linesize);
+				// Copy out so matching (and any governor sleeps) run without the graphics lock
+				frame_ts = os_gettime_ns();
+				frame_linesize = ctx.crop_width * 4;
+				frame = bmalloc((size_t)frame_linesize * ctx.crop_height);
+				for (uint32_t y = 0; y < ctx.crop_height; y++)
+					memcpy(frame + y * frame_linesize, mapped_data + y * linesize, frame_linesize);
     			gs_stagesurface_unmap(ctx.stage);
 			}
 		} else {
@@ -88,8 +109,24 @@ void *hero_detection_thread(void *data)
 			gs_texrender_destroy(ctx.texrender);
 	obs_leave_graphics();
 
+	if (frame) {
+		struct hero_match match;
+		if (do_template_match(frame, ctx.crop_width, ctx.crop_height, frame_linesize, ctx.filter->match_backend,
+				      &ctx.filter->governor, &match)) {
+			// Every scan has a best match, a low score means no hero portrait is on screen
+			if (match.score >= ctx.filter->min_score) {
+				hero_timeline_record(&ctx.filter->timeline, match.hero, match.score, frame_ts);
+				hero_detected_signal(ctx.filter, &match, frame_ts);
+			} else {
+				blog(LOG_DEBUG, "[%s] Best match %s (%.3f) is below the minimum score, not tagging",
+				     __func__, match.hero, match.score);
+			}
+		}
+		bfree(frame);
+	}
+
 done:
 	os_atomic_store_bool(&ctx.filter->hero_detection_running, false);
 	blog(LOG_DEBUG, "[%s] Hero detection thread done", __func__);
 	return NULL;
-}
+}
\ No newline at end of file
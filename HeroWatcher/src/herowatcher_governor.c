@@ -0,0 +1,222 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "herowatcher_governor.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/video-io.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <pthread/qos.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Parses a CPU list like "2,4-5" into a bitmask. Returns false on bad input.
+static bool parse_affinity(const char *list, uint64_t *mask)
+{
+	*mask = 0;
+	const char *p = list;
+	while (*p) {
+		if (*p == ',' || *p == ' ') {
+			p++;
+			continue;
+		}
+
+		char *end;
+		long first = strtol(p, &end, 10);
+		if (end == p)
+			return false;
+		long last = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			last = strtol(p, &end, 10);
+			if (end == p)
+				return false;
+			p = end;
+		}
+
+		if (first < 0 || last < first || last >= 64)
+			return false;
+		for (long cpu = first; cpu <= last; cpu++)
+			*mask |= 1ULL << cpu;
+	}
+	return *mask != 0;
+}
+
+// CPU time consumed by the calling thread
+static uint64_t thread_cpu_ns(void)
+{
+#if defined(_WIN32)
+	// FILETIME counts 100 ns units
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+		return os_gettime_ns();
+	uint64_t kernel = (uint64_t)kernel_time.dwHighDateTime << 32 | kernel_time.dwLowDateTime;
+	uint64_t user = (uint64_t)user_time.dwHighDateTime << 32 | user_time.dwLowDateTime;
+	return (kernel + user) * 100;
+#else
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return os_gettime_ns();
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+bool hero_governor_init(struct hero_governor *gov)
+{
+	if (os_event_init(&gov->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		blog(LOG_ERROR, "[%s] Failed to create governor stop event", __func__);
+		return false;
+	}
+
+	// OBS counters are cumulative, only lag from here on should throttle
+	gov->last_lagged_frames = obs_get_lagged_frames();
+	video_t *video = obs_get_video();
+	gov->last_skipped_frames = video ? video_output_get_skipped_frames(video) : 0;
+	return true;
+}
+
+void hero_governor_free(struct hero_governor *gov)
+{
+	if (gov->stop_event)
+		os_event_destroy(gov->stop_event);
+	gov->stop_event = NULL;
+}
+
+void hero_governor_stop(struct hero_governor *gov)
+{
+	os_atomic_store_bool(&gov->stopping, true);
+	if (gov->stop_event)
+		os_event_signal(gov->stop_event);
+}
+
+void hero_governor_update(struct hero_governor *gov, obs_data_t *settings)
+{
+	gov->budget_ms = (int)obs_data_get_int(settings, "cpu_budget_ms");
+	gov->low_priority = obs_data_get_bool(settings, "low_priority");
+	gov->throttle_on_lag = obs_data_get_bool(settings, "throttle_on_lag");
+
+	const char *affinity = obs_data_get_string(settings, "cpu_affinity");
+	uint64_t mask = 0;
+	if (affinity && *affinity && !parse_affinity(affinity, &mask))
+		blog(LOG_WARNING, "[%s] Ignoring invalid CPU affinity list: %s", __func__, affinity);
+	gov->affinity_mask = mask;
+	gov->affinity_set = mask != 0;
+
+	if (!gov->throttle_on_lag)
+		os_atomic_store_bool(&gov->lagging, false);
+}
+
+void hero_governor_tick(struct hero_governor *gov, float seconds)
+{
+	uint32_t lagged = obs_get_lagged_frames();
+	video_t *video = obs_get_video();
+	uint32_t skipped = video ? video_output_get_skipped_frames(video) : 0;
+
+	bool new_lag = lagged > gov->last_lagged_frames || skipped > gov->last_skipped_frames;
+	gov->last_lagged_frames = lagged;
+	gov->last_skipped_frames = skipped;
+
+	if (!gov->throttle_on_lag)
+		return;
+
+	if (new_lag) {
+		if (!os_atomic_load_bool(&gov->lagging))
+			blog(LOG_DEBUG, "[%s] OBS is lagging, throttling detection", __func__);
+		gov->lag_backoff = HERO_GOVERNOR_LAG_BACKOFF;
+		os_atomic_store_bool(&gov->lagging, true);
+	} else if (gov->lag_backoff > 0.0f) {
+		gov->lag_backoff -= seconds;
+		if (gov->lag_backoff <= 0.0f) {
+			blog(LOG_DEBUG, "[%s] OBS recovered, resuming detection", __func__);
+			os_atomic_store_bool(&gov->lagging, false);
+		}
+	}
+}
+
+bool hero_governor_can_scan(struct hero_governor *gov)
+{
+	return !gov->throttle_on_lag || !os_atomic_load_bool(&gov->lagging);
+}
+
+bool hero_governor_confined(const struct hero_governor *gov)
+{
+	return gov->budget_ms > 0 || gov->low_priority || gov->affinity_set;
+}
+
+void hero_governor_thread_init(struct hero_governor *gov)
+{
+	gov->scan_start_ns = os_gettime_ns();
+	gov->work_used_ns = 0;
+
+#if defined(_WIN32)
+	if (gov->low_priority)
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+	if (gov->affinity_set && !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)gov->affinity_mask))
+		blog(LOG_WARNING, "[%s] Failed to set CPU affinity: %lu", __func__, GetLastError());
+#elif defined(__APPLE__)
+	if (gov->low_priority)
+		pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+	if (gov->affinity_set)
+		blog(LOG_WARNING, "[%s] CPU affinity is not supported on macOS", __func__);
+#elif defined(__linux__)
+	// Linux applies nice values per thread
+	if (gov->low_priority && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19) != 0)
+		blog(LOG_WARNING, "[%s] Failed to lower detection thread priority", __func__);
+	if (gov->affinity_set) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < 64; cpu++) {
+			if (gov->affinity_mask & (1ULL << cpu))
+				CPU_SET(cpu, &set);
+		}
+		int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (ret != 0)
+			blog(LOG_WARNING, "[%s] Failed to set CPU affinity: %d", __func__, ret);
+	}
+#endif
+}
+
+void hero_governor_work_begin(struct hero_governor *gov)
+{
+	gov->work_start_ns = thread_cpu_ns();
+}
+
+bool hero_governor_work_end(struct hero_governor *gov)
+{
+	gov->work_used_ns += thread_cpu_ns() - gov->work_start_ns;
+	uint64_t now = os_gettime_ns();
+
+	// Spread the scan out so matching averages at most budget_ms per second.
+	// Sleep on the stop event so destroy never waits out the budget.
+	if (gov->budget_ms > 0) {
+		uint64_t allowed_ns = gov->scan_start_ns + gov->work_used_ns * 1000 / (uint64_t)gov->budget_ms;
+		if (allowed_ns > now && gov->stop_event)
+			os_event_timedwait(gov->stop_event, (unsigned long)((allowed_ns - now + 999999) / 1000000));
+	}
+
+	if (os_atomic_load_bool(&gov->stopping)) {
+		blog(LOG_DEBUG, "[%s] Aborting scan, filter is being destroyed", __func__);
+		return false;
+	}
+
+	if (!hero_governor_can_scan(gov)) {
+		blog(LOG_DEBUG, "[%s] Aborting scan while OBS is lagging", __func__);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,48 @@
+#ifndef HEROWATCHER_GOVERNOR_H
+#define HEROWATCHER_GOVERNOR_H
+
+#include <obs.h>
+#include <util/threading.h>
+
+// Seconds a scan stays deferred after OBS reports lagged or skipped frames
+#define HERO_GOVERNOR_LAG_BACKOFF 5.0f
+
+struct hero_governor {
+	// Settings
+	int budget_ms;
+	bool low_priority;
+	bool throttle_on_lag;
+	bool affinity_set;
+	uint64_t affinity_mask;
+
+	// Detection thread accounting
+	os_event_t *stop_event;
+	bool stopping;
+	uint64_t scan_start_ns;
+	// Thread CPU time, so preemption by encoders doesn't count against the budget
+	uint64_t work_start_ns;
+	uint64_t work_used_ns;
+
+	// Render thread lag tracking
+	uint32_t last_lagged_frames;
+	uint32_t last_skipped_frames;
+	float lag_backoff;
+	bool lagging;
+};
+
+bool hero_governor_init(struct hero_governor *gov);
+void hero_governor_free(struct hero_governor *gov);
+// Wakes a detection thread sleeping off its budget so it can be joined
+void hero_governor_stop(struct hero_governor *gov);
+void hero_governor_update(struct hero_governor *gov, obs_data_t *settings);
+void hero_governor_tick(struct hero_governor *gov, float seconds);
+bool hero_governor_can_scan(struct hero_governor *gov);
+// Whether any setting restricts the detection thread
+bool hero_governor_confined(const struct hero_governor *gov);
+
+// Detection thread side
+void hero_governor_thread_init(struct hero_governor *gov);
+void hero_governor_work_begin(struct hero_governor *gov);
+bool hero_governor_work_end(struct hero_governor *gov);
+
+#endif
@@ -10,16 +10,315 @@
 #include <util/dstr.h>
 #include <util/bmem.h>
 
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The census search has a POPCNT build picked at runtime, the plugin itself
+// is compiled for the baseline instruction set
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HERO_POPCNT_DISPATCH
+#define HERO_POPCNT_TARGET __attribute__((target("popcnt")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define HERO_POPCNT_DISPATCH
+#define HERO_POPCNT_TARGET
+#endif
+
+#ifdef _MSC_VER
+#define HERO_FORCE_INLINE __forceinline
+#else
+#define HERO_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+// Census search runs on frame and templates downscaled by this factor
+#define HERO_CENSUS_SCALE 4
+// Templates the census pre-screen hands on to NCC for confirmation
+#define HERO_CENSUS_CANDIDATES 3
+
+// Decoded once and shared by every filter, scans only read it
+struct HeroTemplate {
+    std::string path;
+    std::string hero;
+    cv::Mat gray;
+    cv::Mat census_small;
+    cv::Mat census_full;
+};
+
+typedef std::vector<HeroTemplate> HeroTemplateSet;
+
 struct MatchResult {
-    struct dstr filename;
+    const HeroTemplate *templ;
     double score;
     cv::Point location;
 };
 
-bool do_template_match(const uint8_t *rgba_data, int width, int height, int linesize)
+struct CensusCandidate {
+    const HeroTemplate *templ;
+    double score;
+    cv::Point location;
+};
+
+static std::mutex template_mutex;
+static std::shared_ptr<const HeroTemplateSet> template_set;
+
+static std::mutex confine_mutex;
+static int confined_filters;
+static int default_threads = -1;
+#ifdef HERO_POPCNT_DISPATCH
+static bool use_popcnt;
+#endif
+
+// Hardware is the POPCNT instruction, only called from HERO_POPCNT_TARGET code
+template<bool Hardware> static HERO_FORCE_INLINE int popcount64(uint64_t v)
+{
+#if defined(_MSC_VER)
+    if constexpr (Hardware)
+        return (int)__popcnt64(v);
+#elif !defined(HERO_POPCNT_DISPATCH)
+    // Other architectures expand the builtin without a library call
+    return __builtin_popcountll(v);
+#else
+    if constexpr (Hardware)
+        return __builtin_popcountll(v);
+#endif
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((v * 0x0101010101010101ULL) >> 56);
+}
+
+// 3x3 census transform, one bit per neighbour darker than the centre pixel
+static cv::Mat census_transform(const cv::Mat &gray)
+{
+    cv::Mat census = cv::Mat::zeros(gray.size(), CV_8UC1);
+    for (int y = 1; y < gray.rows - 1; ++y) {
+        const uint8_t *above = gray.ptr<uint8_t>(y - 1);
+        const uint8_t *row = gray.ptr<uint8_t>(y);
+        const uint8_t *below = gray.ptr<uint8_t>(y + 1);
+        uint8_t *out = census.ptr<uint8_t>(y);
+        for (int x = 1; x < gray.cols - 1; ++x) {
+            uint8_t c = row[x];
+            out[x] = (uint8_t)((above[x - 1] < c) << 7 | (above[x] < c) << 6 | (above[x + 1] < c) << 5 |
+                               (row[x - 1] < c) << 4 | (row[x + 1] < c) << 3 |
+                               (below[x - 1] < c) << 2 | (below[x] < c) << 1 | (below[x + 1] < c));
+        }
+    }
+    return census;
+}
+
+// Hamming distance of a template placed at (x, y), XOR + popcount over 64-bit words.
+// Border pixels carry no census bits and are skipped. Stops early once over limit.
+template<bool Hardware>
+static HERO_FORCE_INLINE int census_distance(const cv::Mat &frame, const cv::Mat &templ, int x, int y, int limit)
+{
+    const int n = templ.cols - 2;
+    int dist = 0;
+    for (int r = 1; r < templ.rows - 1; ++r) {
+        const uint8_t *a = frame.ptr<uint8_t>(y + r) + x + 1;
+        const uint8_t *b = templ.ptr<uint8_t>(r) + 1;
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t wa, wb;
+            memcpy(&wa, a + i, 8);
+            memcpy(&wb, b + i, 8);
+            dist += popcount64<Hardware>(wa ^ wb);
+        }
+        if (i < n) {
+            uint64_t wa = 0, wb = 0;
+            memcpy(&wa, a + i, n - i);
+            memcpy(&wb, b + i, n - i);
+            dist += popcount64<Hardware>(wa ^ wb);
+        }
+        if (dist > limit)
+            break;
+    }
+    return dist;
+}
+
+template<bool Hardware>
+static HERO_FORCE_INLINE int census_search_area(const cv::Mat &frame, const cv::Mat &templ, cv::Rect area,
+                                                cv::Point *best)
+{
+    int best_dist = INT_MAX;
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        for (int x = area.x; x < area.x + area.width; ++x) {
+            int dist = census_distance<Hardware>(frame, templ, x, y, best_dist);
+            if (dist < best_dist) {
+                best_dist = dist;
+                *best = cv::Point(x, y);
+            }
+        }
+    }
+    return best_dist;
+}
+
+static int census_search_soft(const cv::Mat &frame, const cv::Mat &templ, cv::Rect area, cv::Point *best)
+{
+    return census_search_area<false>(frame, templ, area, best);
+}
+
+#ifdef HERO_POPCNT_DISPATCH
+HERO_POPCNT_TARGET static int census_search_popcnt(const cv::Mat &frame, const cv::Mat &templ, cv::Rect area,
+                                                   cv::Point *best)
+{
+    return census_search_area<true>(frame, templ, area, best);
+}
+#endif
+
+// Best placement of templ inside area (top-left positions), as a score in [-1, 1]
+static double census_search(const cv::Mat &frame, const cv::Mat &templ, cv::Rect area, cv::Point *best)
+{
+#ifdef HERO_POPCNT_DISPATCH
+    int best_dist = use_popcnt ? census_search_popcnt(frame, templ, area, best)
+                               : census_search_soft(frame, templ, area, best);
+#else
+    int best_dist = census_search_soft(frame, templ, area, best);
+#endif
+
+    // Identical descriptors score 1, unrelated ones (half the bits differ) score 0
+    double bits = (double)(templ.cols - 2) * (templ.rows - 2) * 8;
+    return 1.0 - 2.0 * best_dist / bits;
+}
+
+static cv::Rect search_area(const cv::Mat &frame, const cv::Mat &templ)
+{
+    return cv::Rect(0, 0, frame.cols - templ.cols + 1, frame.rows - templ.rows + 1);
+}
+
+static bool census_coarse(const cv::Mat &frame_small, const HeroTemplate &templ, double *score,
+                          cv::Point *location)
+{
+    if (templ.census_small.empty() || templ.census_small.cols > frame_small.cols ||
+        templ.census_small.rows > frame_small.rows)
+        return false;
+
+    cv::Point coarse;
+    *score = census_search(frame_small, templ.census_small, search_area(frame_small, templ.census_small), &coarse);
+    *location = coarse * HERO_CENSUS_SCALE;
+    return true;
+}
+
+// Hero name is the template file name without directory or extension
+static std::string hero_from_path(const char *path)
+{
+    const char *name = path;
+    const char *slash = strrchr(name, '/');
+    const char *backslash = strrchr(name, '\\');
+    if (backslash && (!slash || backslash > slash))
+        slash = backslash;
+    if (slash)
+        name = slash + 1;
+    const char *ext = strrchr(name, '.');
+    return std::string(name, ext ? (size_t)(ext - name) : strlen(name));
+}
+
+static std::shared_ptr<const HeroTemplateSet> load_templates(void)
+{
+    char *template_folder_c = obs_module_file("hero_images");
+    if (!template_folder_c) {
+        blog(LOG_ERROR, "[%s] Failed to get module path for hero_images", __func__);
+        return nullptr;
+    }
+
+    struct dstr template_glob;
+    dstr_init(&template_glob);
+    dstr_printf(&template_glob, "%s/*.png", template_folder_c);
+    bfree(template_folder_c);
+
+    os_glob_t *glob = nullptr;
+    if (os_glob(template_glob.array, 0, &glob) != 0 || !glob) {
+        blog(LOG_WARNING, "[%s] Failed to glob hero_images: %s", __func__, template_glob.array);
+        dstr_free(&template_glob);
+        return nullptr;
+    }
+
+    auto templates = std::make_shared<HeroTemplateSet>();
+    for (size_t i = 0; i < glob->gl_pathc; ++i) {
+        struct os_globent *ent = &glob->gl_pathv[i];
+        if (ent->directory)
+            continue;
+
+        HeroTemplate templ;
+        templ.gray = cv::imread(ent->path, cv::IMREAD_GRAYSCALE);
+        if (templ.gray.empty()) {
+            blog(LOG_WARNING, "[%s] Could not load template: %s", __func__, ent->path);
+            continue;
+        }
+        templ.path = ent->path;
+        templ.hero = hero_from_path(ent->path);
+
+        // Census descriptors are left empty when the template is too small for them
+        cv::Mat templ_small;
+        cv::resize(templ.gray, templ_small,
+                   cv::Size(templ.gray.cols / HERO_CENSUS_SCALE, templ.gray.rows / HERO_CENSUS_SCALE), 0, 0,
+                   cv::INTER_AREA);
+        if (templ_small.cols >= 3 && templ_small.rows >= 3) {
+            templ.census_small = census_transform(templ_small);
+            templ.census_full = census_transform(templ.gray);
+        }
+        templates->push_back(std::move(templ));
+    }
+
+    os_globfree(glob);
+    blog(LOG_INFO, "[%s] Loaded %zu hero templates from %s", __func__, templates->size(), template_glob.array);
+    dstr_free(&template_glob);
+
+    if (templates->empty())
+        return nullptr;
+    return templates;
+}
+
+// Loads on first use, a failed load is retried on the next scan
+static std::shared_ptr<const HeroTemplateSet> get_templates(void)
+{
+    std::lock_guard<std::mutex> lock(template_mutex);
+    if (!template_set)
+        template_set = load_templates();
+    return template_set;
+}
+
+void hero_matching_init(void)
+{
+    default_threads = cv::getNumThreads();
+#ifdef HERO_POPCNT_DISPATCH
+    use_popcnt = cv::checkHardwareSupport(CV_CPU_POPCNT);
+#endif
+}
+
+void hero_matching_confine(bool confine)
+{
+    // OpenCV's worker pool would escape the governor's budget, priority and
+    // affinity. The thread count is process wide, so while any filter is
+    // confined it also applies to other OpenCV users in the OBS process.
+    std::lock_guard<std::mutex> lock(confine_mutex);
+    if (confine) {
+        if (confined_filters++ == 0)
+            cv::setNumThreads(0);
+    } else if (confined_filters > 0 && --confined_filters == 0) {
+        cv::setNumThreads(default_threads);
+    }
+}
+
+void hero_matching_free(void)
+{
+    std::lock_guard<std::mutex> lock(template_mutex);
+    template_set.reset();
+}
+
+bool do_template_match(const uint8_t *rgba_data, int width, int height, int linesize,
+                       enum hero_match_backend backend, struct hero_governor *governor, struct hero_match *match)
 {
     blog(LOG_INFO, "[%s] Starting OpenCV matching (%dx%d)", __func__, width, height);
 
+    hero_governor_work_begin(governor);
+
     // Copy RGBA into OpenCV Mat
     cv::Mat rgba(height, width, CV_8UC4);
     for (int y = 0; y < height; ++y)
@@ -29,12 +328,14 @@ bool do_template_match(const uint8_t *rgba_data, int width, int height, int line
     cv::Mat gray;
     cv::cvtColor(rgba, gray, cv::COLOR_RGBA2GRAY);
 
-        // Save the current frame for debugging
+#ifdef HEROWATCHER_DEBUG_IMAGES
+    // Save the current frame for debugging
     if (!cv::imwrite("match_output_rgba.png", rgba)) {
         blog(LOG_ERROR, "[%s] Failed to save output image!", __func__);
     } else {
-        blog(LOG_INFO, "[%s] Output saved to match_output.png", __func__);
+        blog(LOG_INFO, "[%s] Output saved to match_output_rgba.png", __func__);
     }
+#endif
 
     // Resize if either dimension is smaller than required
     bool resized = false;
@@ -53,68 +354,139 @@ bool do_template_match(const uint8_t *rgba_data, int width, int height, int line
     if (resized) {
         cv::resize(gray, gray, cv::Size(resized_width, resized_height), 0, 0, cv::INTER_LINEAR);
         blog(LOG_DEBUG, "[%s] Resized input to %dx%d for template matching", __func__, resized_width, resized_height);
+#ifdef HEROWATCHER_DEBUG_IMAGES
         cv::imwrite("match_input_resized.png", gray);
+#endif
     }
 
+#ifdef HEROWATCHER_DEBUG_IMAGES
     // Save the current frame for debugging
     if (!cv::imwrite("match_output.png", gray)) {
         blog(LOG_ERROR, "[%s] Failed to save output image!", __func__);
     } else {
         blog(LOG_INFO, "[%s] Output saved to match_output.png", __func__);
     }
+#endif
 
-    char *template_folder_c = obs_module_file("hero_images");
-    if (!template_folder_c) {
-        blog(LOG_ERROR, "[%s] Failed to get module path for hero_images", __func__);
-        return false;
+    // Census descriptors of the frame, downscaled for the coarse search
+    cv::Mat frame_census_small;
+    cv::Mat frame_census;
+    if (backend != HERO_MATCH_NCC) {
+        cv::Mat gray_small;
+        cv::resize(gray, gray_small,
+                   cv::Size(gray.cols / HERO_CENSUS_SCALE, gray.rows / HERO_CENSUS_SCALE), 0, 0,
+                   cv::INTER_AREA);
+        frame_census_small = census_transform(gray_small);
+        if (backend == HERO_MATCH_CENSUS)
+            frame_census = census_transform(gray);
     }
 
-    struct dstr template_glob;
-    dstr_init(&template_glob);
-    dstr_printf(&template_glob, "%s/*.png", template_folder_c);
-    bfree(template_folder_c);
+    std::shared_ptr<const HeroTemplateSet> templates = get_templates();
 
-    os_glob_t *glob = nullptr;
-    if (os_glob(template_glob.array, 0, &glob) != 0 || !glob) {
-        blog(LOG_WARNING, "[%s] Failed to glob hero_images: %s", __func__, template_glob.array);
-        dstr_free(&template_glob);
+    if (!hero_governor_work_end(governor) || !templates)
         return false;
-    }
 
     std::vector<MatchResult> results;
+    std::vector<CensusCandidate> candidates;
+    bool aborted = false;
 
-    for (size_t i = 0; i < glob->gl_pathc; ++i) {
-        struct os_globent *ent = &glob->gl_pathv[i];
-        if (ent->directory)
+    for (const HeroTemplate &templ : *templates) {
+        if (templ.gray.cols > gray.cols || templ.gray.rows > gray.rows) {
+            blog(LOG_WARNING, "[%s] Template %s is larger than frame, skipping", __func__, templ.path.c_str());
             continue;
+        }
 
-        cv::Mat templ = cv::imread(ent->path, cv::IMREAD_GRAYSCALE);
-        if (templ.empty()) {
-            blog(LOG_WARNING, "[%s] Could not load template: %s", __func__, ent->path);
-            continue;
+        hero_governor_work_begin(governor);
+
+        MatchResult result_entry;
+        result_entry.score = 0.0;
+        bool matched = true;
+
+        if (backend == HERO_MATCH_NCC) {
+            cv::Mat result;
+            cv::matchTemplate(gray, templ.gray, result, cv::TM_CCOEFF_NORMED);
+
+            double minVal, maxVal;
+            cv::Point minLoc, maxLoc;
+            cv::minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc);
+            result_entry.score = maxVal;
+            result_entry.location = maxLoc;
+        } else {
+            double score;
+            cv::Point location;
+            matched = census_coarse(frame_census_small, templ, &score, &location);
+            if (!matched) {
+                blog(LOG_WARNING, "[%s] Template %s is too small for census matching, skipping", __func__,
+                     templ.path.c_str());
+            } else if (backend == HERO_MATCH_CENSUS) {
+                // Refine the coarse hit at full resolution
+                cv::Rect window(location.x - HERO_CENSUS_SCALE, location.y - HERO_CENSUS_SCALE,
+                                2 * HERO_CENSUS_SCALE + 1, 2 * HERO_CENSUS_SCALE + 1);
+                window &= search_area(frame_census, templ.census_full);
+                if (window.area() > 0)
+                    score = census_search(frame_census, templ.census_full, window, &location);
+                result_entry.score = score;
+                result_entry.location = location;
+            } else {
+                candidates.push_back({&templ, score, location});
+                matched = false;
+            }
         }
 
-        if (templ.cols > gray.cols || templ.rows > gray.rows) {
-            blog(LOG_WARNING, "[%s] Template %s is larger than frame, skipping", __func__, ent->path);
-            continue;
+        if (matched) {
+            result_entry.templ = &templ;
+            results.push_back(result_entry);
         }
 
-        cv::Mat result;
-        cv::matchTemplate(gray, templ, result, cv::TM_CCOEFF_NORMED);
+        if (!hero_governor_work_end(governor)) {
+            aborted = true;
+            break;
+        }
+    }
+
+    // Pre-screen: only the best census candidates get NCC, and only around their coarse hit
+    if (backend == HERO_MATCH_CENSUS_NCC && !aborted) {
+        size_t keep = std::min(candidates.size(), (size_t)HERO_CENSUS_CANDIDATES);
+        std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                          [](const CensusCandidate &a, const CensusCandidate &b) {
+                              return a.score > b.score;
+                          });
+
+        for (size_t i = 0; i < keep; ++i) {
+            hero_governor_work_begin(governor);
+            const CensusCandidate &c = candidates[i];
+            const cv::Mat &templ = c.templ->gray;
+            const int margin = 2 * HERO_CENSUS_SCALE;
+            cv::Rect roi(c.location.x - margin, c.location.y - margin, templ.cols + 2 * margin,
+                         templ.rows + 2 * margin);
+            roi &= cv::Rect(0, 0, gray.cols, gray.rows);
+            if (roi.width < templ.cols || roi.height < templ.rows)
+                roi = cv::Rect(0, 0, gray.cols, gray.rows);
+
+            cv::Mat result;
+            cv::matchTemplate(gray(roi), templ, result, cv::TM_CCOEFF_NORMED);
 
-        double minVal, maxVal;
-        cv::Point minLoc, maxLoc;
-        cv::minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc);
+            double minVal, maxVal;
+            cv::Point minLoc, maxLoc;
+            cv::minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc);
 
-        MatchResult match;
-        dstr_init_copy(&match.filename, ent->path);
-        match.score = maxVal;
-        match.location = maxLoc;
-        results.push_back(match);
+            MatchResult result_entry;
+            result_entry.templ = c.templ;
+            result_entry.score = maxVal;
+            result_entry.location = maxLoc + roi.tl();
+            results.push_back(result_entry);
+
+            if (!hero_governor_work_end(governor)) {
+                aborted = true;
+                break;
+            }
+        }
     }
 
-    os_globfree(glob);
-    dstr_free(&template_glob);
+    if (aborted) {
+        blog(LOG_INFO, "[%s] Matching throttled, partial results discarded.", __func__);
+        return false;
+    }
 
     if (results.empty()) {
         blog(LOG_INFO, "[%s] No templates matched.", __func__);
@@ -127,11 +499,12 @@ bool do_template_match(const uint8_t *rgba_data, int width, int height, int line
         });
 
     blog(LOG_INFO, "[%s] Best match: %s (score: %.3f)", __func__,
-         best->filename.array, best->score);
-
-
-    for (auto &r : results)
-        dstr_free(&r.filename);
+         best->templ->path.c_str(), best->score);
 
+    const std::string &hero = best->templ->hero;
+    size_t name_len = std::min(hero.size(), sizeof(match->hero) - 1);
+    memcpy(match->hero, hero.data(), name_len);
+    match->hero[name_len] = '\0';
+    match->score = best->score;
     return true;
 }
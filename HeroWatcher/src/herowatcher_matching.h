@@ -1,12 +1,37 @@
+#ifndef HEROWATCHER_MATCHING_H
+#define HEROWATCHER_MATCHING_H
+
 #include <obs.h>
+#include "herowatcher_governor.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-bool do_template_match(const uint8_t *rgba_data, int width, int height, int linesize);
+enum hero_match_backend {
+	HERO_MATCH_NCC,
+	HERO_MATCH_CENSUS,
+	HERO_MATCH_CENSUS_NCC,
+};
+
+struct hero_match {
+	char hero[64];
+	double score;
+};
+
+// One-time setup from obs_module_load, before any detection thread starts
+void hero_matching_init(void);
+// Counted per filter. While any filter is confined OpenCV runs single threaded.
+void hero_matching_confine(bool confine);
+// Drops the cached hero templates, from obs_module_unload
+void hero_matching_free(void);
+
+bool do_template_match(const uint8_t *rgba_data, int width, int height, int linesize,
+		       enum hero_match_backend backend, struct hero_governor *governor, struct hero_match *match);
 
 
 #ifdef __cplusplus
 }
 #endif
+
+#endif
@@ -92,17 +92,37 @@ static void *hero_watcher_create(obs_data_t *settings, obs_source_t *context)
 	filter->param_add = gs_effect_get_param_by_name(filter->effect, "add_val");
 	filter->param_multiplier = gs_effect_get_param_by_name(filter->effect, "multiplier");
 
+	if (!hero_governor_init(&filter->governor)) {
+		obs_enter_graphics();
+		gs_effect_destroy(filter->effect);
+		obs_leave_graphics();
+		bfree(filter);
+		return NULL;
+	}
+
+	if (!hero_timeline_init(&filter->timeline, context))
+		blog(LOG_WARNING, "[%s] Hero timeline disabled, tags will only be logged", __func__);
+
 	obs_source_update(context, settings);
 
 	signal_handler_t *sh_filter = obs_source_get_signal_handler(context);
 	if (!sh_filter)
 	{
 		blog(LOG_ERROR, "[%s] Failed to get signal handler", __func__);
-		filter->active = false;
+		if (filter->opencv_confined)
+			hero_matching_confine(false);
+		hero_timeline_free(&filter->timeline);
+		hero_governor_free(&filter->governor);
+		obs_enter_graphics();
+		gs_effect_destroy(filter->effect);
+		obs_leave_graphics();
+		bfree(filter);
 		return NULL;
 	}
 
 	signal_handler_connect(sh_filter, "enable", hero_watcher_enable, filter);
+	// timestamp is os_gettime_ns() of the frame the verdict was made on
+	signal_handler_add(sh_filter, "void hero_detected(ptr source, string hero, float score, int timestamp)");
 
 	return filter;
 }
@@ -110,6 +130,14 @@ static void *hero_watcher_create(obs_data_t *settings, obs_source_t *context)
 static void hero_watcher_destroy(void *data)
 {
 	struct hero_watcher_data *filter = data;
+	hero_governor_stop(&filter->governor);
+	if (filter->hero_thread_created)
+		pthread_join(filter->hero_thread, NULL);
+	hero_governor_free(&filter->governor);
+	if (filter->opencv_confined)
+		hero_matching_confine(false);
+	hero_timeline_free(&filter->timeline);
+
 	obs_enter_graphics();
 	gs_effect_destroy(filter->effect);
 	obs_leave_graphics();
@@ -161,6 +189,15 @@ static void hero_watcher_defaults(obs_data_t *settings)
 	obs_data_set_default_bool(settings, "preview_weapon", false);
 	obs_data_set_default_bool(settings, "tagging_enabled", false);
 	obs_data_set_default_int(settings, "refresh_seconds", 30);
+	obs_data_set_default_int(settings, "match_backend", HERO_MATCH_NCC);
+	obs_data_set_default_double(settings, "min_score", 0.6);
+	obs_data_set_default_int(settings, "cpu_budget_ms", 0);
+	obs_data_set_default_bool(settings, "low_priority", true);
+	obs_data_set_default_string(settings, "cpu_affinity", "");
+	obs_data_set_default_bool(settings, "throttle_on_lag", true);
+	obs_data_set_default_int(settings, "timeline_format", HERO_TIMELINE_CSV);
+	obs_data_set_default_bool(settings, "timeline_index", false);
+	obs_data_set_default_string(settings, "timeline_path", "");
 }
 
 static bool preview_weapon_enabled(obs_properties_t *props, obs_property_t *p, obs_data_t *settings)
@@ -195,6 +232,42 @@ static obs_properties_t *hero_watcher_properties(void *data)
 	// Tagging Settings
 	obs_properties_add_int(props, "refresh_seconds", obs_module_text("RefreshTimer"), 5, 300, 1);
 	obs_properties_add_bool(props, "tagging_enabled", obs_module_text("TaggingEnable"));
+	obs_property_t *backend = obs_properties_add_list(props, "match_backend", obs_module_text("MatchBackend"),
+							  OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(backend, obs_module_text("MatchBackend.NCC"), HERO_MATCH_NCC);
+	obs_property_list_add_int(backend, obs_module_text("MatchBackend.Census"), HERO_MATCH_CENSUS);
+	obs_property_list_add_int(backend, obs_module_text("MatchBackend.CensusNCC"), HERO_MATCH_CENSUS_NCC);
+	obs_property_t *min_score = obs_properties_add_float_slider(props, "min_score", obs_module_text("MinScore"),
+								    0.0, 1.0, 0.01);
+	obs_property_set_long_description(min_score, obs_module_text("MinScore.Description"));
+
+	// Timeline Settings
+	obs_properties_t *timeline_group_props = obs_properties_create();
+	obs_properties_add_group(props, "timeline_group", obs_module_text("TimelineGroup"), OBS_GROUP_NORMAL,
+				 timeline_group_props);
+	obs_property_t *format = obs_properties_add_list(timeline_group_props, "timeline_format",
+							 obs_module_text("TimelineFormat"), OBS_COMBO_TYPE_LIST,
+							 OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(format, "CSV", HERO_TIMELINE_CSV);
+	obs_property_list_add_int(format, "JSON Lines", HERO_TIMELINE_JSONL);
+	obs_properties_add_bool(timeline_group_props, "timeline_index", obs_module_text("TimelineIndex"));
+	obs_property_t *path = obs_properties_add_path(timeline_group_props, "timeline_path",
+						       obs_module_text("TimelinePath"), OBS_PATH_DIRECTORY, NULL,
+						       NULL);
+	obs_property_set_long_description(path, obs_module_text("TimelinePath.Description"));
+
+	// Governor Settings
+	obs_properties_t *governor_group_props = obs_properties_create();
+	obs_properties_add_group(props, "governor_group", obs_module_text("GovernorGroup"), OBS_GROUP_NORMAL,
+				 governor_group_props);
+	obs_property_t *budget = obs_properties_add_int(governor_group_props, "cpu_budget_ms",
+							obs_module_text("CpuBudget"), 0, 1000, 5);
+	obs_property_set_long_description(budget, obs_module_text("CpuBudget.Description"));
+	obs_properties_add_bool(governor_group_props, "low_priority", obs_module_text("LowPriority"));
+	obs_property_t *affinity = obs_properties_add_text(governor_group_props, "cpu_affinity",
+							   obs_module_text("CpuAffinity"), OBS_TEXT_DEFAULT);
+	obs_property_set_long_description(affinity, obs_module_text("CpuAffinity.Description"));
+	obs_properties_add_bool(governor_group_props, "throttle_on_lag", obs_module_text("ThrottleOnLag"));
 
 	return props;
 }
@@ -213,8 +286,20 @@ static void hero_watcher_update(void *data, obs_data_t *settings)
 	// Update Tagging Settings
 	filter->refresh_seconds  = (int)obs_data_get_int(settings, "refresh_seconds");
 	filter->tagging = obs_data_get_bool(settings, "tagging_enabled");
+	filter->match_backend = (enum hero_match_backend)obs_data_get_int(settings, "match_backend");
+	filter->min_score = obs_data_get_double(settings, "min_score");
 	filter->remaining_time = (float)filter->refresh_seconds;
 
+	// Update Governor Settings
+	hero_governor_update(&filter->governor, settings);
+	bool confined = hero_governor_confined(&filter->governor);
+	if (confined != filter->opencv_confined) {
+		hero_matching_confine(confined);
+		filter->opencv_confined = confined;
+	}
+
+	// Update Timeline Settings
+	hero_timeline_update(&filter->timeline, settings);
 }
 
 static void calc_crop_dimensions(struct hero_watcher_data *filter, struct vec2 *mul_val, struct vec2 *add_val)
@@ -258,11 +343,19 @@ static void init_hero_detection(struct hero_watcher_data *filter)
 	}
     os_atomic_store_bool(&filter->hero_detection_running, true);
 
+	// Previous scan has already finished, reap it before reusing the handle
+	if (filter->hero_thread_created) {
+		pthread_join(filter->hero_thread, NULL);
+		filter->hero_thread_created = false;
+	}
+
     int ret = pthread_create(&filter->hero_thread, NULL, hero_detection_thread, filter);
     if (ret != 0) {
         blog(LOG_ERROR, "[%s] Failed to create hero detection thread: %d", __func__, ret);
         os_atomic_store_bool(&filter->hero_detection_running, false);
-    }
+    } else {
+		filter->hero_thread_created = true;
+	}
 }
 
 static void hero_watcher_tick(void *data, float seconds)
@@ -271,10 +364,12 @@ static void hero_watcher_tick(void *data, float seconds)
 	vec2_zero(&filter->mul_val);
 	vec2_zero(&filter->add_val);
 	calc_crop_dimensions(filter, &filter->mul_val, &filter->add_val);
+	hero_governor_tick(&filter->governor, seconds);
 	if(filter->tagging && filter->active && !filter->preview)
 	{
 		filter->remaining_time -= seconds;
-		if(filter->remaining_time < 0){
+		// Hold the scan while OBS is lagging, it runs once rendering recovers
+		if(filter->remaining_time < 0 && hero_governor_can_scan(&filter->governor)){
 				blog(LOG_DEBUG, "[%s] Resetting timer...", __func__);
 				filter->remaining_time = (float)filter->refresh_seconds;
 				init_hero_detection(filter);
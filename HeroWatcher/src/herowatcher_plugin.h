@@ -6,6 +6,10 @@
 #include <graphics/graphics.h>
 #include <obs.h>
 
+#include "herowatcher_governor.h"
+#include "herowatcher_timeline.h"
+#include "herowatcher_matching.h"
+
 static const enum gs_color_space preferred_spaces[] = {
 	GS_CS_SRGB,
 	GS_CS_SRGB_16F,
@@ -39,8 +43,14 @@ struct hero_watcher_data {
 	int refresh_seconds;
 	float remaining_time;
 	bool tagging;
+	enum hero_match_backend match_backend;
+	double min_score;
 	bool hero_detection_running;
+	bool hero_thread_created;
     pthread_t hero_thread;
+	struct hero_governor governor;
+	bool opencv_confined;
+	struct hero_timeline timeline;
 	enum gs_color_space source_space;
 	enum gs_color_format color_format;
 	const char * technique;
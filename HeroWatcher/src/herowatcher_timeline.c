@@ -0,0 +1,578 @@
+#include "herowatcher_timeline.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/bmem.h>
+
+#ifdef ENABLE_FRONTEND_API
+#include <obs-frontend-api.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Index file is a magic header followed by little-endian {time_ms, byte offset} pairs
+static const char index_magic[8] = {'H', 'W', 'T', 'L', 'I', 'D', 'X', '1'};
+
+enum hero_timeline_op_type {
+	HERO_TIMELINE_OP_OPEN,
+	HERO_TIMELINE_OP_DATA,
+	HERO_TIMELINE_OP_CLOSE,
+};
+
+struct hero_timeline_mark {
+	uint64_t time_ms;
+	uint64_t offset;
+};
+
+struct hero_timeline_op {
+	enum hero_timeline_op_type type;
+	struct dstr text;
+	DARRAY(struct hero_timeline_mark) marks;
+	enum hero_timeline_format format;
+	bool write_index;
+	struct hero_timeline_op *next;
+};
+
+static void free_op(struct hero_timeline_op *op)
+{
+	dstr_free(&op->text);
+	da_free(op->marks);
+	bfree(op);
+}
+
+// Caller holds tl->mutex
+static struct hero_timeline_op *push_op(struct hero_timeline *tl, enum hero_timeline_op_type type)
+{
+	struct hero_timeline_op *op = bzalloc(sizeof(*op));
+	op->type = type;
+	if (tl->ops_tail)
+		tl->ops_tail->next = op;
+	else
+		tl->ops_head = op;
+	tl->ops_tail = op;
+	return op;
+}
+
+static void sync_file(FILE *file)
+{
+	fflush(file);
+#ifdef _WIN32
+	_commit(_fileno(file));
+#else
+	fsync(fileno(file));
+#endif
+}
+
+static void write_u64_le(FILE *file, uint64_t val)
+{
+	uint8_t bytes[8];
+	for (int i = 0; i < 8; i++)
+		bytes[i] = (uint8_t)(val >> (i * 8));
+	fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+static void close_files(struct hero_timeline *tl)
+{
+	if (tl->file) {
+		sync_file(tl->file);
+		fclose(tl->file);
+		tl->file = NULL;
+	}
+	if (tl->index) {
+		sync_file(tl->index);
+		fclose(tl->index);
+		tl->index = NULL;
+	}
+}
+
+static void open_files(struct hero_timeline *tl, struct hero_timeline_op *op)
+{
+	close_files(tl);
+
+	struct dstr dir;
+	dstr_init_copy(&dir, op->text.array);
+	char *slash = strrchr(dir.array, '/');
+	if (slash) {
+		*slash = 0;
+		os_mkdirs(dir.array);
+	}
+	dstr_free(&dir);
+
+	// Never append to an earlier session, its header and index offsets would not line up
+	const char *extension = op->format == HERO_TIMELINE_CSV ? ".csv" : ".jsonl";
+	struct dstr path;
+	dstr_init(&path);
+	for (int i = 1;; i++) {
+		if (i == 1)
+			dstr_printf(&path, "%s%s", op->text.array, extension);
+		else
+			dstr_printf(&path, "%s (%d)%s", op->text.array, i, extension);
+		if (!os_file_exists(path.array))
+			break;
+	}
+
+	tl->file = os_fopen(path.array, "wb");
+	if (!tl->file) {
+		blog(LOG_ERROR, "[%s] Failed to open timeline: %s", __func__, path.array);
+		dstr_free(&path);
+		return;
+	}
+
+	tl->file_offset = 0;
+	if (op->format == HERO_TIMELINE_CSV) {
+		static const char header[] = "time_ms,hero,score\n";
+		fwrite(header, 1, sizeof(header) - 1, tl->file);
+		tl->file_offset = sizeof(header) - 1;
+	}
+
+	if (op->write_index) {
+		struct dstr index_path;
+		dstr_init_copy(&index_path, path.array);
+		dstr_cat(&index_path, ".idx");
+		tl->index = os_fopen(index_path.array, "wb");
+		if (!tl->index)
+			blog(LOG_WARNING, "[%s] Failed to open timeline index: %s", __func__, index_path.array);
+		else
+			fwrite(index_magic, 1, sizeof(index_magic), tl->index);
+		dstr_free(&index_path);
+	}
+
+	blog(LOG_INFO, "[%s] Writing hero timeline to %s", __func__, path.array);
+	dstr_free(&path);
+}
+
+static bool write_data(struct hero_timeline *tl, struct hero_timeline_op *op)
+{
+	if (!tl->file || !op->text.len)
+		return false;
+
+	fwrite(op->text.array, 1, op->text.len, tl->file);
+	if (tl->index) {
+		for (size_t i = 0; i < op->marks.num; i++) {
+			write_u64_le(tl->index, op->marks.array[i].time_ms);
+			write_u64_le(tl->index, tl->file_offset + op->marks.array[i].offset);
+		}
+	}
+	tl->file_offset += op->text.len;
+	return true;
+}
+
+static void *hero_timeline_thread(void *data)
+{
+	struct hero_timeline *tl = data;
+	os_set_thread_name("herowatcher: timeline writer");
+
+	for (;;) {
+		os_event_timedwait(tl->wake, HERO_TIMELINE_FLUSH_MS);
+
+		pthread_mutex_lock(&tl->mutex);
+		struct hero_timeline_op *op = tl->ops_head;
+		tl->ops_head = NULL;
+		tl->ops_tail = NULL;
+		bool stopping = tl->stopping;
+		pthread_mutex_unlock(&tl->mutex);
+
+		// One flush + fsync per batch rather than per entry
+		bool dirty = false;
+		while (op) {
+			struct hero_timeline_op *next = op->next;
+			switch (op->type) {
+			case HERO_TIMELINE_OP_OPEN:
+				open_files(tl, op);
+				dirty = false;
+				break;
+			case HERO_TIMELINE_OP_DATA:
+				dirty |= write_data(tl, op);
+				break;
+			case HERO_TIMELINE_OP_CLOSE:
+				close_files(tl);
+				dirty = false;
+				break;
+			}
+			free_op(op);
+			op = next;
+		}
+
+		if (dirty) {
+			sync_file(tl->file);
+			if (tl->index)
+				sync_file(tl->index);
+		}
+
+		if (stopping)
+			break;
+	}
+
+	close_files(tl);
+	return NULL;
+}
+
+#ifdef ENABLE_FRONTEND_API
+static void hero_timeline_frontend_event(enum obs_frontend_event event, void *data)
+{
+	struct hero_timeline *tl = data;
+
+	switch (event) {
+	case OBS_FRONTEND_EVENT_RECORDING_STARTED:
+		hero_timeline_start_session(tl, HERO_SESSION_RECORDING);
+		break;
+	case OBS_FRONTEND_EVENT_RECORDING_STOPPED:
+		hero_timeline_end_session(tl, HERO_SESSION_RECORDING);
+		if (obs_frontend_streaming_active())
+			hero_timeline_start_session(tl, HERO_SESSION_STREAMING);
+		break;
+	case OBS_FRONTEND_EVENT_RECORDING_PAUSED:
+		hero_timeline_pause(tl, true);
+		break;
+	case OBS_FRONTEND_EVENT_RECORDING_UNPAUSED:
+		hero_timeline_pause(tl, false);
+		break;
+	case OBS_FRONTEND_EVENT_RECORDING_FILE_CHANGED:
+		// Split recordings get one timeline per file
+		hero_timeline_start_session(tl, HERO_SESSION_RECORDING);
+		break;
+	case OBS_FRONTEND_EVENT_STREAMING_STARTED:
+		hero_timeline_start_session(tl, HERO_SESSION_STREAMING);
+		break;
+	case OBS_FRONTEND_EVENT_STREAMING_STOPPED:
+		hero_timeline_end_session(tl, HERO_SESSION_STREAMING);
+		break;
+	default:
+		break;
+	}
+}
+#endif
+
+bool hero_timeline_init(struct hero_timeline *tl, obs_source_t *source)
+{
+	tl->source = source;
+	pthread_mutex_init_value(&tl->mutex);
+	if (pthread_mutex_init(&tl->mutex, NULL) != 0) {
+		blog(LOG_ERROR, "[%s] Failed to create timeline mutex", __func__);
+		return false;
+	}
+	if (os_event_init(&tl->wake, OS_EVENT_TYPE_AUTO) != 0) {
+		blog(LOG_ERROR, "[%s] Failed to create timeline event", __func__);
+		pthread_mutex_destroy(&tl->mutex);
+		return false;
+	}
+
+	int ret = pthread_create(&tl->thread, NULL, hero_timeline_thread, tl);
+	if (ret != 0) {
+		blog(LOG_ERROR, "[%s] Failed to create timeline writer thread: %d", __func__, ret);
+		os_event_destroy(tl->wake);
+		pthread_mutex_destroy(&tl->mutex);
+		return false;
+	}
+	tl->thread_active = true;
+
+#ifdef ENABLE_FRONTEND_API
+	obs_frontend_add_event_callback(hero_timeline_frontend_event, tl);
+#endif
+	return true;
+}
+
+void hero_timeline_free(struct hero_timeline *tl)
+{
+	if (!tl->thread_active)
+		return;
+
+#ifdef ENABLE_FRONTEND_API
+	obs_frontend_remove_event_callback(hero_timeline_frontend_event, tl);
+#endif
+
+	pthread_mutex_lock(&tl->mutex);
+	tl->stopping = true;
+	pthread_mutex_unlock(&tl->mutex);
+	os_event_signal(tl->wake);
+	pthread_join(tl->thread, NULL);
+	tl->thread_active = false;
+
+	os_event_destroy(tl->wake);
+	pthread_mutex_destroy(&tl->mutex);
+	bfree(tl->directory);
+	tl->directory = NULL;
+	bfree(tl->session_directory);
+	tl->session_directory = NULL;
+	bfree(tl->session_name);
+	tl->session_name = NULL;
+}
+
+void hero_timeline_update(struct hero_timeline *tl, obs_data_t *settings)
+{
+	if (!tl->thread_active)
+		return;
+
+	const char *directory = obs_data_get_string(settings, "timeline_path");
+
+	pthread_mutex_lock(&tl->mutex);
+	tl->format = (enum hero_timeline_format)obs_data_get_int(settings, "timeline_format");
+	tl->write_index = obs_data_get_bool(settings, "timeline_index");
+	bfree(tl->directory);
+	tl->directory = directory && *directory ? bstrdup(directory) : NULL;
+	bool idle = tl->session == HERO_SESSION_NONE;
+	pthread_mutex_unlock(&tl->mutex);
+
+	// Pick up a recording or stream that was already running when the filter loaded
+	if (!idle)
+		return;
+#ifdef ENABLE_FRONTEND_API
+	if (obs_frontend_recording_active()) {
+		hero_timeline_start_session(tl, HERO_SESSION_RECORDING);
+		if (obs_frontend_recording_paused())
+			hero_timeline_pause(tl, true);
+	} else if (obs_frontend_streaming_active())
+		hero_timeline_start_session(tl, HERO_SESSION_STREAMING);
+#else
+	// Without the frontend there are no recording events, so the session follows the filter
+	hero_timeline_start_session(tl, HERO_SESSION_FILTER);
+#endif
+}
+
+static char *default_directory(void)
+{
+#ifdef ENABLE_FRONTEND_API
+	char *record_path = obs_frontend_get_current_record_output_path();
+	if (record_path && *record_path)
+		return record_path;
+	bfree(record_path);
+#endif
+	return obs_module_config_path("timelines");
+}
+
+// Caller holds tl->mutex
+static void close_session(struct hero_timeline *tl)
+{
+	if (tl->session_opened)
+		push_op(tl, HERO_TIMELINE_OP_CLOSE);
+	tl->session_opened = false;
+	tl->session = HERO_SESSION_NONE;
+	bfree(tl->session_directory);
+	tl->session_directory = NULL;
+	bfree(tl->session_name);
+	tl->session_name = NULL;
+	tl->pause_start_ns = 0;
+	tl->paused_ns = 0;
+	tl->last_pause_start_ns = 0;
+	tl->last_pause_end_ns = 0;
+}
+
+void hero_timeline_start_session(struct hero_timeline *tl, enum hero_timeline_session session)
+{
+	if (!tl->thread_active)
+		return;
+
+	char *directory = NULL;
+	pthread_mutex_lock(&tl->mutex);
+	// Recordings always rotate, anything else only starts a session if none is running
+	if (tl->session != HERO_SESSION_NONE && session != HERO_SESSION_RECORDING) {
+		pthread_mutex_unlock(&tl->mutex);
+		return;
+	}
+	directory = tl->directory ? bstrdup(tl->directory) : NULL;
+	pthread_mutex_unlock(&tl->mutex);
+
+	// The frontend may be queried for the record path, so keep it out of the lock
+	if (!directory)
+		directory = default_directory();
+
+	// Named after the session start so it lines up with the recording, the file
+	// itself is only created on the first tag
+	char *name = os_generate_formatted_filename("", true, "HeroWatcher %CCYY-%MM-%DD %hh-%mm-%ss");
+	char *dot = strrchr(name, '.');
+	if (dot)
+		*dot = 0;
+
+	pthread_mutex_lock(&tl->mutex);
+	bool signal = tl->session_opened;
+	close_session(tl);
+	tl->session = session;
+	tl->session_format = tl->format;
+	tl->session_start_ns = os_gettime_ns();
+	tl->session_directory = directory;
+	tl->session_name = name;
+	pthread_mutex_unlock(&tl->mutex);
+
+	if (signal)
+		os_event_signal(tl->wake);
+}
+
+void hero_timeline_end_session(struct hero_timeline *tl, enum hero_timeline_session session)
+{
+	if (!tl->thread_active)
+		return;
+
+	pthread_mutex_lock(&tl->mutex);
+	bool ended = tl->session == session;
+	bool signal = ended && tl->session_opened;
+	if (ended)
+		close_session(tl);
+	pthread_mutex_unlock(&tl->mutex);
+
+	if (signal)
+		os_event_signal(tl->wake);
+}
+
+void hero_timeline_pause(struct hero_timeline *tl, bool paused)
+{
+	if (!tl->thread_active)
+		return;
+
+	uint64_t now = os_gettime_ns();
+	pthread_mutex_lock(&tl->mutex);
+	if (tl->session == HERO_SESSION_RECORDING) {
+		if (paused && !tl->pause_start_ns) {
+			tl->pause_start_ns = now;
+		} else if (!paused && tl->pause_start_ns) {
+			tl->paused_ns += now - tl->pause_start_ns;
+			tl->last_pause_start_ns = tl->pause_start_ns;
+			tl->last_pause_end_ns = now;
+			tl->pause_start_ns = 0;
+		}
+	}
+	pthread_mutex_unlock(&tl->mutex);
+}
+
+// Caller holds tl->mutex. Maps a capture time onto the recording's own clock, which
+// stops while paused. Returns false for frames captured during a pause.
+static bool session_time_ms(struct hero_timeline *tl, uint64_t timestamp_ns, uint64_t *time_ms)
+{
+	if (tl->pause_start_ns && timestamp_ns >= tl->pause_start_ns)
+		return false;
+
+	// A scan that started before the last pause finished must not lose that pause
+	uint64_t paused_ns = tl->paused_ns;
+	if (timestamp_ns < tl->last_pause_end_ns) {
+		if (timestamp_ns >= tl->last_pause_start_ns)
+			return false;
+		paused_ns -= tl->last_pause_end_ns - tl->last_pause_start_ns;
+	}
+
+	uint64_t elapsed_ns = timestamp_ns > tl->session_start_ns ? timestamp_ns - tl->session_start_ns : 0;
+	*time_ms = (elapsed_ns > paused_ns ? elapsed_ns - paused_ns : 0) / 1000000;
+	return true;
+}
+
+// Replaces characters that are not allowed in file names on any platform
+static void cat_file_name(struct dstr *dst, const char *name)
+{
+	size_t start = dst->len;
+	dstr_cat(dst, name && *name ? name : "Unnamed");
+	for (char *c = dst->array + start; *c; c++) {
+		if ((unsigned char)*c < 0x20 || strchr("<>:\"/\\|?*", *c))
+			*c = '_';
+	}
+}
+
+// Caller holds tl->mutex. Filter names are only unique per parent, so both go in the file name.
+static void open_session(struct hero_timeline *tl)
+{
+	// The writer picks the extension once it knows the name is free
+	struct hero_timeline_op *op = push_op(tl, HERO_TIMELINE_OP_OPEN);
+	dstr_printf(&op->text, "%s/%s ", tl->session_directory, tl->session_name);
+	obs_source_t *parent = obs_filter_get_parent(tl->source);
+	if (parent) {
+		cat_file_name(&op->text, obs_source_get_name(parent));
+		dstr_cat(&op->text, " - ");
+	}
+	cat_file_name(&op->text, obs_source_get_name(tl->source));
+	dstr_replace(&op->text, "\\", "/");
+	op->format = tl->session_format;
+	op->write_index = tl->write_index;
+
+	tl->session_opened = true;
+}
+
+static void cat_csv_field(struct dstr *dst, const char *str)
+{
+	dstr_cat_ch(dst, '"');
+	for (const char *c = str; *c; c++) {
+		if (*c == '"')
+			dstr_cat_ch(dst, '"');
+		dstr_cat_ch(dst, *c);
+	}
+	dstr_cat_ch(dst, '"');
+}
+
+static void cat_json_string(struct dstr *dst, const char *str)
+{
+	dstr_cat_ch(dst, '"');
+	for (const char *c = str; *c; c++) {
+		switch (*c) {
+		case '"':
+			dstr_cat(dst, "\\\"");
+			break;
+		case '\\':
+			dstr_cat(dst, "\\\\");
+			break;
+		case '\n':
+			dstr_cat(dst, "\\n");
+			break;
+		case '\r':
+			dstr_cat(dst, "\\r");
+			break;
+		case '\t':
+			dstr_cat(dst, "\\t");
+			break;
+		default:
+			if ((unsigned char)*c < 0x20)
+				dstr_catf(dst, "\\u%04x", (unsigned char)*c);
+			else
+				dstr_cat_ch(dst, *c);
+			break;
+		}
+	}
+	dstr_cat_ch(dst, '"');
+}
+
+void hero_timeline_record(struct hero_timeline *tl, const char *hero, double score, uint64_t timestamp_ns)
+{
+	if (!tl->thread_active)
+		return;
+
+	pthread_mutex_lock(&tl->mutex);
+	if (tl->session == HERO_SESSION_NONE) {
+		pthread_mutex_unlock(&tl->mutex);
+		blog(LOG_DEBUG, "[%s] No recording or stream active, dropping tag for %s", __func__, hero);
+		return;
+	}
+
+	uint64_t time_ms;
+	if (!session_time_ms(tl, timestamp_ns, &time_ms)) {
+		pthread_mutex_unlock(&tl->mutex);
+		blog(LOG_DEBUG, "[%s] Recording paused, dropping tag for %s", __func__, hero);
+		return;
+	}
+
+	if (!tl->session_opened)
+		open_session(tl);
+	struct hero_timeline_op *op = tl->ops_tail;
+	if (!op || op->type != HERO_TIMELINE_OP_DATA)
+		op = push_op(tl, HERO_TIMELINE_OP_DATA);
+
+	struct hero_timeline_mark *mark = da_push_back_new(op->marks);
+	mark->time_ms = time_ms;
+	mark->offset = op->text.len;
+
+	if (tl->session_format == HERO_TIMELINE_CSV) {
+		dstr_catf(&op->text, "%llu,", (unsigned long long)time_ms);
+		cat_csv_field(&op->text, hero);
+		dstr_catf(&op->text, ",%.3f\n", score);
+	} else {
+		dstr_catf(&op->text, "{\"time_ms\":%llu,\"hero\":", (unsigned long long)time_ms);
+		cat_json_string(&op->text, hero);
+		dstr_catf(&op->text, ",\"score\":%.3f}\n", score);
+	}
+
+	bool flush = op->text.len >= HERO_TIMELINE_BATCH_BYTES;
+	pthread_mutex_unlock(&tl->mutex);
+
+	if (flush)
+		os_event_signal(tl->wake);
+}
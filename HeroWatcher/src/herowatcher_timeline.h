@@ -0,0 +1,71 @@
+#ifndef HEROWATCHER_TIMELINE_H
+#define HEROWATCHER_TIMELINE_H
+
+#include <obs.h>
+#include <util/threading.h>
+
+// Writer wakes at least this often, or early once a batch reaches the byte limit
+#define HERO_TIMELINE_FLUSH_MS 1000
+#define HERO_TIMELINE_BATCH_BYTES 4096
+
+enum hero_timeline_format {
+	HERO_TIMELINE_CSV,
+	HERO_TIMELINE_JSONL,
+};
+
+enum hero_timeline_session {
+	HERO_SESSION_NONE,
+	HERO_SESSION_RECORDING,
+	HERO_SESSION_STREAMING,
+	HERO_SESSION_FILTER,
+};
+
+struct hero_timeline_op;
+
+struct hero_timeline {
+	// Filter the timeline belongs to, names the files
+	obs_source_t *source;
+
+	// Settings
+	enum hero_timeline_format format;
+	bool write_index;
+	char *directory;
+
+	// Guarded by mutex
+	pthread_mutex_t mutex;
+	enum hero_timeline_session session;
+	enum hero_timeline_format session_format;
+	uint64_t session_start_ns;
+	char *session_directory;
+	char *session_name;
+	bool session_opened;
+	// Recording pauses, excluded from entry times
+	uint64_t pause_start_ns;
+	uint64_t paused_ns;
+	uint64_t last_pause_start_ns;
+	uint64_t last_pause_end_ns;
+	struct hero_timeline_op *ops_head;
+	struct hero_timeline_op *ops_tail;
+	bool stopping;
+
+	// Writer thread
+	pthread_t thread;
+	os_event_t *wake;
+	bool thread_active;
+	FILE *file;
+	FILE *index;
+	uint64_t file_offset;
+};
+
+bool hero_timeline_init(struct hero_timeline *tl, obs_source_t *source);
+void hero_timeline_free(struct hero_timeline *tl);
+void hero_timeline_update(struct hero_timeline *tl, obs_data_t *settings);
+
+void hero_timeline_start_session(struct hero_timeline *tl, enum hero_timeline_session session);
+void hero_timeline_end_session(struct hero_timeline *tl, enum hero_timeline_session session);
+void hero_timeline_pause(struct hero_timeline *tl, bool paused);
+// Opens the session file on the first tag, so sessions without tags leave no file.
+// timestamp_ns is when the frame was captured, not when matching finished
+void hero_timeline_record(struct hero_timeline *tl, const char *hero, double score, uint64_t timestamp_ns);
+
+#endif
@@ -19,6 +19,8 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #include <obs-module.h>
 #include <plugin-support.h>
 
+#include "herowatcher_matching.h"
+
 extern struct obs_source_info hero_watcher;
 
 OBS_DECLARE_MODULE()
@@ -26,6 +28,7 @@ OBS_MODULE_USE_DEFAULT_LOCALE(PLUGIN_NAME, "en-US")
 
 bool obs_module_load(void)
 {
+	hero_matching_init();
 	obs_register_source(&hero_watcher);
 	obs_log(LOG_INFO, "plugin loaded successfully (version %s)", PLUGIN_VERSION);
 	return true;
@@ -33,5 +36,6 @@ bool obs_module_load(void)
 
 void obs_module_unload(void)
 {
+	hero_matching_free();
 	obs_log(LOG_INFO, "plugin unloaded");
 }
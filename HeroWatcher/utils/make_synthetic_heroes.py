@@ -0,0 +1,80 @@
+"""Generates synthetic hero templates and labelled frames for herowatcher-bench.
+
+The real hero images are not redistributable, so this draws a deterministic set
+of blocky icons instead and pastes them into noisy frames:
+
+    python make_synthetic_heroes.py OUT
+    herowatcher-bench --compare --data OUT --frames OUT/frames
+
+OUT/hero_images holds one template per hero, OUT/frames holds "NNN-<hero>.png"
+frames that show that hero somewhere with brightness and noise changes.
+"""
+
+import argparse
+import os
+import random
+
+from PIL import Image, ImageDraw
+
+FRAME_SIZE = (520, 171)
+ICON_SIZE = 64
+BLOCK = 8
+
+
+def make_icon(rng):
+    icon = Image.new("L", (ICON_SIZE, ICON_SIZE), rng.randrange(256))
+    draw = ImageDraw.Draw(icon)
+    for y in range(0, ICON_SIZE, BLOCK):
+        for x in range(0, ICON_SIZE, BLOCK):
+            if rng.random() < 0.6:
+                draw.rectangle([x, y, x + BLOCK - 1, y + BLOCK - 1], fill=rng.randrange(256))
+    for _ in range(3):
+        x, y = rng.randrange(ICON_SIZE), rng.randrange(ICON_SIZE)
+        r = rng.randrange(6, 20)
+        draw.ellipse([x - r, y - r, x + r, y + r], outline=rng.randrange(256), width=3)
+    return icon
+
+
+def make_frame(rng, icon, brightness, noise):
+    frame = Image.effect_noise(FRAME_SIZE, 40).point(lambda v: v // 2 + 40)
+    shown = icon.point(lambda v: max(0, min(255, int(v * brightness))))
+    x = rng.randrange(FRAME_SIZE[0] - ICON_SIZE)
+    y = rng.randrange(FRAME_SIZE[1] - ICON_SIZE)
+    frame.paste(shown, (x, y))
+    if noise:
+        grain = Image.effect_noise(FRAME_SIZE, noise)
+        frame = Image.blend(frame, grain, 0.15)
+    return frame.convert("RGB")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("out", help="output directory")
+    parser.add_argument("--heroes", type=int, default=43, help="number of templates (default 43)")
+    parser.add_argument("--frames", type=int, default=100, help="number of frames (default 100)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default 1)")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    hero_dir = os.path.join(args.out, "hero_images")
+    frame_dir = os.path.join(args.out, "frames")
+    os.makedirs(hero_dir, exist_ok=True)
+    os.makedirs(frame_dir, exist_ok=True)
+
+    icons = {}
+    for i in range(args.heroes):
+        name = f"Hero{i:02d}"
+        icons[name] = make_icon(rng)
+        icons[name].convert("RGB").save(os.path.join(hero_dir, f"{name}.png"))
+
+    names = sorted(icons)
+    for i in range(args.frames):
+        name = rng.choice(names)
+        frame = make_frame(rng, icons[name], rng.uniform(0.8, 1.2), rng.choice([0, 20, 40]))
+        frame.save(os.path.join(frame_dir, f"{i:03d}-{name}.png"))
+
+    print(f"Wrote {args.heroes} templates to {hero_dir} and {args.frames} frames to {frame_dir}")
+
+
+if __name__ == "__main__":
+    main()